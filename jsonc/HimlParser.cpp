@@ -38,110 +38,165 @@ Value* HimlParser::parse(char* src) {
     return obj;
 }
 
+namespace {
+struct HimlFrame {
+    BuildFrame obj;
+    BuildFrame children;
+    bool isRoot;
+    //newlines seen before a nested object, they still separate entries
+    int lines;
+};
+}
+
 JsonNode* HimlParser::parseObj(const char* tagName, bool isRoot) {
-    JsonNode* obj = alloc(Type::Object);
-    obj->value.child = NULL;
+    //iterative: nested objects are frames on stack, not recursive calls
+    FrameStack<HimlFrame> stack(allocator);
+    JsonNode* root = NULL;
+    JsonNode* obj;
+    HimlFrame* top;
+    const char* key = NULL;
+    int lines;
+    char c;
 
-    if (tagName) {
-        JsonNode* tag_name = alloc(Type::String);
-        tag_name->value.str = (char*)tagName;
-        obj->insert_pair("_type", tag_name);
+open:
+    //object at cur, attached to the parent as pair key or as a child
+    if (stack.size() >= maxDepth) {
+        snprintf(error, 128, "Too deep nesting at %s", cur);
+        return NULL;
     }
-
-    if (isRoot) {
-        skipWhitespace();
+    obj = alloc(Type::Object);
+    obj->value.child = NULL;
+    if (stack.empty()) {
+        root = obj;
+    }
+    else if (key) {
+        obj->name = key;
+        stack.back()->obj.append(obj);
     }
     else {
-        ++cur;
-        skipWhitespace();
-        if (*cur == '}') {
-            ++cur;
-            return obj;
-        }
+        stack.back()->children.append(obj);
     }
 
-    JsonNode* children = alloc(Type::Array);
-    obj->insert_pair("_children", children);
-
-    int count = 0;
-    while (true)
     {
-        ++count;
-        int lines = 0;
-        //noname object
-        if (*cur == '{') {
-            JsonNode* obj = parseObj();
-            if (!obj) return obj;
-            children->insert(obj);
-            lines = skipWhitespace();
+        BuildFrame frame = { obj, NULL };
+        if (tagName) {
+            JsonNode* tag_name = alloc(Type::String);
+            tag_name->value.str = (char*)tagName;
+            tag_name->name = "_type";
+            frame.append(tag_name);
         }
-        else {
-            //read name
-            JsonNode key;
-            key._type = Type::String;
-            parseStr(&key);
-            lines = skipWhitespace();
 
-            char c = *cur;
-            //read pair
-            if (c == '=') {
-                ++cur;
-                lines += skipWhitespace();
-                JsonNode* val = parseVal();
-                if (!key.value.str || !val) return NULL;
-                lines += skipWhitespace();
-                if (*cur == '{') {
-                    //tag name
-                    JsonNode* nobj = parseObj(val->value.str);
-                    obj->insert_pair(key.value.str, nobj);
-                }
-                else {
-                    obj->insert_pair(key.value.str, val);
-                }
-                lines += skipWhitespace();
-            }
-            //read named object
-            else if (c == '{') {
-                //tag name
-                JsonNode* obj = parseObj(key.value.str);
-                children->insert(obj);
-                lines = skipWhitespace();
-            }
-            else {
-                JsonNode* child = alloc(Type::String);
-                child->value.str = key.value.str;
-                children->insert(child);
-            }
+        if (isRoot) {
+            skipWhitespace();
         }
-
-        char c = *cur;
-        if (c == ',') {
+        else {
             ++cur;
             skipWhitespace();
-            continue;
+            if (*cur == '}') {
+                ++cur;
+                goto closed;
+            }
         }
-        else if (!isRoot && c == '}') {
+
+        JsonNode* children = alloc(Type::Array);
+        children->value.child = NULL;
+        children->name = "_children";
+        frame.append(children);
+
+        top = stack.push();
+        top->obj = frame;
+        top->children.node = children;
+        top->children.tail = NULL;
+        top->isRoot = isRoot;
+        top->lines = 0;
+        isRoot = false;
+    }
+
+entry:
+    top = stack.back();
+    lines = 0;
+    //noname object
+    if (*cur == '{') {
+        top->lines = 0;
+        key = NULL;
+        tagName = NULL;
+        goto open;
+    }
+    else {
+        //read name
+        JsonNode name;
+        name._type = Type::String;
+        parseStr(&name);
+        lines = skipWhitespace();
+
+        c = *cur;
+        //read pair
+        if (c == '=') {
             ++cur;
-            break;
-        }
-        else if (c == 0) {
-            if (!isRoot) {
-                snprintf(error, 128, "Unexpected end of stream");
-                return obj;
+            lines += skipWhitespace();
+            if (*cur == '{') {
+                top->lines = lines;
+                key = name.value.str;
+                tagName = NULL;
+                goto open;
             }
-            break;
+            JsonNode* val = parseVal();
+            if (!name.value.str || !val) return NULL;
+            lines += skipWhitespace();
+            if (*cur == '{') {
+                //tag name
+                top->lines = lines;
+                key = name.value.str;
+                tagName = val->value.str;
+                goto open;
+            }
+            val->name = name.value.str;
+            top->obj.append(val);
+            lines += skipWhitespace();
+        }
+        //read named object
+        else if (c == '{') {
+            top->lines = 0;
+            key = NULL;
+            tagName = name.value.str;
+            goto open;
         }
         else {
-            if (lines) {
-                continue;
-            }
-            snprintf(error, 128, "Unexpected token '%c' at %s", *cur, cur);
-            return obj;
+            JsonNode* child = alloc(Type::String);
+            child->value.str = name.value.str;
+            top->children.append(child);
         }
     }
-    children->reverse();
-    obj->reverse();
-    return obj;
+
+separator:
+    c = *cur;
+    if (c == ',') {
+        ++cur;
+        skipWhitespace();
+        goto entry;
+    }
+    else if (!stack.back()->isRoot && c == '}') {
+        ++cur;
+    }
+    else if (c == 0) {
+        if (!stack.back()->isRoot) {
+            snprintf(error, 128, "Unexpected end of stream");
+            return root;
+        }
+    }
+    else {
+        if (lines) {
+            goto entry;
+        }
+        snprintf(error, 128, "Unexpected token '%c' at %s", *cur, cur);
+        return root;
+    }
+    stack.pop();
+
+closed:
+    if (stack.empty()) return root;
+    lines = stack.back()->lines + skipWhitespace();
+    goto separator;
 }
 
 JsonNode* HimlParser::parseVal() {
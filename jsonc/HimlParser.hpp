@@ -23,6 +23,8 @@ namespace jsonc {
         char *delayStrTerminate;
     public:
         bool insertTopLevelObject = false;
+        /** Objects nested deeper than this are an error */
+        size_t maxDepth = 1024;
         HimlParser() : src(NULL), cur(NULL), allocator(NULL), delayStrTerminate(NULL) {
             error[0] = 0;
         }
@@ -40,9 +42,7 @@ namespace jsonc {
         
     private:
         inline JsonNode* alloc(Type type) {
-            JsonNode* v = (JsonNode*)allocator->allocate(sizeof(JsonNode));
-            v->_type = type;
-            return v;
+            return allocator->allocNode(type);
         }
         JsonNode* parseObj(const char* tagName = NULL, bool isRoot = false);
         JsonNode* parseVal();
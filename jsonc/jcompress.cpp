@@ -59,40 +59,62 @@ static void writeSize(std::ostream &out, uint8_t type, int64_t val) {
     }
 }
 
+namespace {
+struct WriteFrame {
+    JsonIterator it;
+    JsonIterator end;
+};
+}
+
+void JCWriter::addStr(const char* str, size_t len) {
+    size_t i;
+    if (findStr(str, len, &i)) return;
+    i = stringTable.size();
+    stringTable[std::string(str, len)] = i;
+    stringPool.push_back(std::string(str, len));
+    cache.put(str, i);
+}
+
+bool JCWriter::findStr(const char* str, size_t len, size_t* index) {
+    if (cache.find(str, index)) return true;
+    auto it = stringTable.find(std::string(str, len));
+    if (it == stringTable.end()) return false;
+    *index = it->second;
+    cache.put(str, it->second);
+    return true;
+}
+
 void JCWriter::makeStrPool(Value *v) {
+    FrameStack<WriteFrame> stack;
+
+value:
     switch (v->type()) {
-        case Type::String: {
-            auto str = v->as_str();
-            auto it = stringTable.find(str);
-            if (it == stringTable.end()) {
-                size_t i = stringTable.size();
-                stringTable[str] = i;
-                stringPool.push_back(str);
-            }
-            break;
-        }
-        case Type::Object: {
-            for (auto p = v->begin(); p != v->end(); ++p) {
-                Value key(Type::String);
-                key.value.str = (char*)p.get_name();
-                Value *val = *p;
-                
-                makeStrPool(&key);
-                
-                //set value
-                makeStrPool(val);
-            }
+        case Type::String:
+            addStr(v->as_str(), v->str_len());
             break;
-        }
+        case Type::Object:
         case Type::Array: {
-            for (auto p = v->begin(); p != v->end(); ++p) {
-                makeStrPool(*p);
-            }
+            WriteFrame* frame = stack.push();
+            frame->it = v->begin();
+            frame->end = v->end();
             break;
         }
         default:
             break;
     }
+
+    while (!stack.empty()) {
+        WriteFrame* top = stack.back();
+        if (!(top->it != top->end)) {
+            stack.pop();
+            continue;
+        }
+        v = *top->it;
+        const char* name = top->it.get_name();
+        ++top->it;
+        if (name) addStr(name, strlen(name));
+        goto value;
+    }
 }
 
 void JCWriter::write(Value *v, std::ostream &out) {
@@ -100,6 +122,8 @@ void JCWriter::write(Value *v, std::ostream &out) {
     int32_t version = 1;
     out.write((char*)(&version), 4);
 
+    //addresses of an earlier tree may be reused by this one
+    cache.clear();
     makeStrPool(v);
     int32_t n = (int32_t)stringPool.size();
     out.write((char*)(&n), 4);
@@ -115,37 +139,30 @@ void JCWriter::write(Value *v, std::ostream &out) {
 }
 
 void JCWriter::writeValue(Value *v, std::ostream &out) {
+    FrameStack<WriteFrame> stack;
+
+value:
     switch (v->type()) {
         case Type::String: {
             auto str = v->as_str();
-            auto it = stringTable.find(str);
-            if (it == stringTable.end()) {
-                printf("ERROR: miss str pool: %s\n", str);
+            size_t len = v->str_len();
+            size_t index;
+            if (!findStr(str, len, &index)) {
+                printf("ERROR: miss str pool: %.*s\n", (int)len, str);
                 break;
             }
 
             uint8_t type = jc_ref;
-            writeSize(out, type, it->second);
+            writeSize(out, type, index);
             //puts("~");
             break;
         }
-        case Type::Object: {
-            writeSize(out, jc_object, v->size());
-            for (auto p = v->begin(); p != v->end(); ++p) {
-                Value key(Type::String);
-                key.value.str = (char*)p.get_name();
-                Value* val = *p;
-                writeValue(&key, out);
-                //set value
-                writeValue(val, out);
-            }
-            break;
-        }
+        case Type::Object:
         case Type::Array: {
-            writeSize(out, jc_array, v->size());
-            for (auto p = v->begin(); p != v->end(); ++p) {
-                writeValue(*p, out);
-            }
+            writeSize(out, v->type() == Type::Object ? jc_object : jc_array, v->size());
+            WriteFrame* frame = stack.push();
+            frame->it = v->begin();
+            frame->end = v->end();
             break;
         }
         case Type::Boolean: {
@@ -189,6 +206,27 @@ void JCWriter::writeValue(Value *v, std::ostream &out) {
         default:
             break;
     }
+
+    while (!stack.empty()) {
+        WriteFrame* top = stack.back();
+        if (!(top->it != top->end)) {
+            stack.pop();
+            continue;
+        }
+        v = *top->it;
+        const char* name = top->it.get_name();
+        ++top->it;
+        if (name) {
+            size_t index;
+            if (!findStr(name, strlen(name), &index)) {
+                printf("ERROR: miss str pool: %s\n", name);
+            }
+            else {
+                writeSize(out, jc_ref, index);
+            }
+        }
+        goto value;
+    }
 }
 
 
@@ -251,30 +289,63 @@ Value* JCReader::read() {
     pool.resize(poolSize);
     for (int32_t i=0; i<poolSize; ++i) {
         pool[i] = readValue();
+        if (!pool[i]) return NULL;
     }
 
     return readValue();
 }
 
+const char* JCReader::readKey() {
+    int c = readByte();
+    if (c == EOF) return NULL;
+    jc_type type = (jc_type)((c >> 4) & 0x0f);
+    uint8_t subType = c & 0x0f;
+    int64_t size = readSize(this, type, subType);
+    if (type == jc_ref) {
+        if (size < 0 || size >= (int64_t)pool.size()) return NULL;
+        return pool[size]->value.str;
+    }
+    if (type == jc_string) {
+        const char* str = buffer + pos;
+        pos += size + 1;
+        return str;
+    }
+    return NULL;
+}
+
+namespace {
+struct ReadFrame {
+    BuildFrame list;
+    int64_t remaining;
+};
+}
+
 JsonNode* JCReader::readValue(JsonNode* out) {
+    //iterative: open containers are frames, children are appended in order
+    FrameStack<ReadFrame> stack(allocator);
+    JsonNode* root = NULL;
+    JsonNode* val;
+    const char* key = NULL;
+    int64_t count = 0;
 
+value: {
     int c = readByte();
     if (c == EOF) return NULL;
     uint8_t t = c;
     //inStream.read((char*)(&t), 1);
     jc_type type = (jc_type)((t >> 4) & 0xff);
     uint8_t subType =  t & 0x0f;
+    count = 0;
     
     switch (type) {
         case jc_int: {
-            JsonNode*val = alloc(Type::Integer);
+            val = alloc(Type::Integer);
             int64_t size = readSize(this, type, subType);
             val->value.i = size;
-            return val;
             break;
         }
         case jc_float: {
-            JsonNode* val = alloc(Type::Float);
+            val = alloc(Type::Float);
             if (subType < 11) {
                 val->value.d = (double)subType;
             } else if (subType == jc_int64) {
@@ -288,44 +359,41 @@ JsonNode* JCReader::readValue(JsonNode* out) {
             } else {
                 val->value.d = 0;
             }
-            return val;
             break;
         }
         case jc_primi: {
             if (subType == jc_null) {
-                return alloc(Type::Null);
+                val = alloc(Type::Null);
             }
             else if (subType == jc_true) {
-                JsonNode* val = alloc(Type::Boolean);
+                val = alloc(Type::Boolean);
                 val->value.b = true;
-                return val;
             }
             else if (subType == jc_false) {
-                JsonNode* val = alloc(Type::Boolean);
+                val = alloc(Type::Boolean);
                 val->value.b = false;
-                return val;
             }
             else {
-                return alloc(Type::Null);
+                val = alloc(Type::Null);
             }
             break;
         }
-        case jc_array: {
-            int64_t size = readSize(this, type, subType);
-            JsonNode* value = alloc(Type::Array);
-            for (int i=0; i<size; ++i) {
-                JsonNode*v = readValue();
-                value->insert(v);
+        case jc_array:
+        case jc_object: {
+            if (stack.size() >= maxDepth) {
+                printf("ERROR: too deep nesting\n");
+                return NULL;
             }
-            value->reverse();
-            return value;
+            count = readSize(this, type, subType);
+            val = alloc(type == jc_object ? Type::Object : Type::Array);
+            val->value.child = NULL;
             break;
         }
         case jc_string: {
-            JsonNode* value = alloc(Type::String);
+            val = alloc(Type::String);
             int64_t size = readSize(this, type, subType);
 
-            value->value.str = buffer + pos;
+            val->value.str = buffer + pos;
             pos += size + 1;
 
             /*char *str = (char*)malloc(size+1);
@@ -335,39 +403,56 @@ JsonNode* JCReader::readValue(JsonNode* out) {
 
             //stringTable.push_back(*s);
             //printf("%s\n", s.c_str());
-            return value;
             break;
         }
         case jc_ref: {
             int64_t size = readSize(this, type, subType);
             if (size < pool.size()) {
                 JsonNode*v = pool[size];
-                JsonNode* val = out;
+                val = stack.empty() ? out : NULL;
                 if (!val) val = alloc(Type::String);
                 val->value.str = v->value.str;
-                return val;
             }
-            return alloc(Type::Null);
-            break;
-        }
-        case jc_object: {
-            int64_t size = readSize(this, type, subType);
-            JsonNode* value = alloc(Type::Object);
-            for (int i=0; i<size; ++i) {
-                JsonNode key;
-                readValue(&key);
-                JsonNode* v = readValue();
-                value->insert_pair(key.value.str, v);
+            else {
+                val = alloc(Type::Null);
             }
-            value->reverse();
-            return value;
             break;
         }
         default: {
             printf("ERROR: unknow type: %d", type);
+            val = alloc(Type::Null);
             break;
         }
     }
+}
 
-    return alloc(Type::Null);
+    if (stack.empty()) {
+        root = val;
+    }
+    else {
+        ReadFrame* top = stack.back();
+        if (top->list.node->_type == Type::Object) val->name = key;
+        top->list.append(val);
+        --top->remaining;
+    }
+    if (count > 0 && (val->_type == Type::Array || val->_type == Type::Object)) {
+        ReadFrame* frame = stack.push();
+        frame->list.node = val;
+        frame->list.tail = NULL;
+        frame->remaining = count;
+    }
+
+    while (!stack.empty()) {
+        ReadFrame* top = stack.back();
+        if (top->remaining <= 0) {
+            stack.pop();
+            continue;
+        }
+        if (top->list.node->_type == Type::Object) {
+            key = readKey();
+            if (!key) return NULL;
+        }
+        goto value;
+    }
+    return root;
 }
@@ -17,6 +17,7 @@
 #include <fstream>
 #include <cstring>
 #include "jparser.hpp"
+#include "jintern.hpp"
 
 namespace jsonc {
 
@@ -49,11 +50,15 @@ enum jc_typeExt {
 class JCWriter {
     std::map<const std::string, size_t> stringTable;
     std::vector<std::string> stringPool;
+    //pool index by address, skips the map for repeated keys
+    PointerCache cache;
 public:    
     void write(Value *v, std::ostream &outStream);
 private:
+    bool findStr(const char* str, size_t len, size_t* index);
     void writeValue(Value *v, std::ostream &outStream);
     void makeStrPool(Value *v);
+    void addStr(const char* str, size_t len);
 };
 
 class JCReader {
@@ -63,20 +68,23 @@ class JCReader {
     int pos;
     JsonAllocator *allocator;
 public:
+    /** Containers nested deeper than this are an error */
+    size_t maxDepth = 1024;
+
     JCReader(char* buf, int size, JsonAllocator *allocator) : buffer(buf), size(size), pos(0), 
         allocator(allocator){}
     Value* read();
 private:
     inline JsonNode* alloc(Type type) {
-        JsonNode* v = (JsonNode*)allocator->allocate(sizeof(JsonNode));
-        v->_type = type;
-        return v;
+        return allocator->allocNode(type);
     }
 
     /**
     * Must keep buf memery invalide.
     */
     JsonNode* readValue(JsonNode* out = NULL);
+    /** Object key, a pool reference or an inline string. NULL on error */
+    const char* readKey();
 
 public:
     bool readData(char* data, int len);
@@ -27,112 +27,184 @@ void JEncoder::writeData(const char *data, int size, int at) {
     }
 }
 
+namespace {
+struct EncodeFrame {
+    JsonIterator it;
+    JsonIterator end;
+    //next slot of the offset table
+    int pos;
+};
+}
+
+void JEncoder::addStr(const char* str, size_t len) {
+    size_t i;
+    if (cache.find(str, &i)) return;
+    std::string text(str, len);
+    auto it = stringTable.find(text);
+    if (it == stringTable.end()) {
+        i = stringTable.size();
+        stringTable[text] = i;
+        stringPool.push_back(text);
+    }
+    else {
+        i = it->second;
+    }
+    cache.put(str, i);
+}
+
+size_t JEncoder::strPos(const char* str, size_t len) {
+    size_t pos;
+    if (cache.find(str, &pos)) return pos;
+    pos = stringTable[std::string(str, len)];
+    cache.put(str, pos);
+    return pos;
+}
+
 void JEncoder::makeStrPool(Value *v) {
+    FrameStack<EncodeFrame> stack;
+
+value:
     switch (v->type()) {
-        case Type::String: {
-            auto str = v->as_str();
-            auto it = stringTable.find(str);
-            if (it == stringTable.end()) {
-                size_t i = stringTable.size();
-                stringTable[str] = i;
-                stringPool.push_back(str);
-            }
-            break;
-        }
-        case Type::Object: {
-            for (auto p = v->begin(); p != v->end(); ++p) {
-                Value key(Type::String);
-                key.value.str = (char*)p.get_name();
-                Value* val = *p;
-                makeStrPool(&key);
-                makeStrPool(val);
-            }
+        case Type::String:
+            addStr(v->as_str(), v->str_len());
             break;
-        }
+        case Type::Object:
         case Type::Array: {
-            for (auto p = v->begin(); p != v->end(); ++p) {
-                makeStrPool(*p);
-            }
+            EncodeFrame* frame = stack.push();
+            frame->it = v->begin();
+            frame->end = v->end();
             break;
         }
         default:
             break;
     }
+
+    while (!stack.empty()) {
+        EncodeFrame* top = stack.back();
+        if (!(top->it != top->end)) {
+            stack.pop();
+            continue;
+        }
+        v = *top->it;
+        const char* name = top->it.get_name();
+        ++top->it;
+        if (name) addStr(name, strlen(name));
+        goto value;
+    }
+}
+
+void JEncoder::writeKeyTable(Value* v, uint32_t size, uint32_t cap) {
+    //member number + 1, 0: empty. Keys are pooled, equal keys share an offset
+    std::vector<uint32_t> slots(cap, 0);
+    std::vector<size_t> keyPos(size);
+    uint32_t m = 0;
+    for (auto it = v->begin(); it != v->end(); ++it, ++m) {
+        const char* name = it.get_name();
+        size_t pos = strPos(name, strlen(name));
+        keyPos[m] = pos;
+        uint32_t i = key_hash(name) & (cap - 1);
+        //the first of duplicate keys wins
+        while (slots[i] && keyPos[slots[i] - 1] != pos) i = (i + 1) & (cap - 1);
+        if (!slots[i]) slots[i] = m + 1;
+    }
+    writeData((char*)slots.data(), cap * sizeof(uint32_t));
+}
+
+//padding and unused fields too, readers of version 4 trust _len
+static inline void clearValue(Value* v) {
+    memset((void*)v, 0, sizeof(Value));
 }
 
 void JEncoder::writeValue(Value *v) {
+    //iterative: each open container keeps the position of its next offset slot
+    FrameStack<EncodeFrame> stack;
+
+value:
     switch (v->type()) {
     case Type::String: {
         Value dup;
+        clearValue(&dup);
         auto str = v->as_str();
+        size_t len = v->str_len();
         dup._type = Type::String;
         dup._flag = 1;
         dup.value.imuInfo.selfOffset = buffer.size();
-        dup.value.imuInfo.sizeOrPos = stringTable[str];
-        writeData((char*)(&dup), sizeof(Value));
-        break;
-    }
-    case Type::Object: {
-        Value dup;
-        dup._type = Type::Object;
-        dup._flag = 1;
-        dup.value.imuInfo.selfOffset = buffer.size();
-        int size = v->size();
-        dup.value.imuInfo.sizeOrPos = size;
+        dup.value.imuInfo.sizeOrPos = strPos(str, len);
         writeData((char*)(&dup), sizeof(Value));
-
-        int pos = buffer.size();
-        fillEmpty(sizeof(int32_t) * size * 2);
-        for (auto p = v->begin(); p != v->end(); ++p) {
-            Value key(Type::String);
-            key.value.str = (char*)p.get_name();
-            Value* val = *p;
-
-            std::string name = key.value.str;
-            int32_t key_pos = stringTable[name];
-            writeData((char*)(&key_pos), 4, pos);
-            pos += 4;
-
-            int32_t val_pos = buffer.size();
-            writeData((char*)(&val_pos), 4, pos);
-            pos += 4;
-
-            writeValue(val);
-        }
         break;
     }
+    case Type::Object:
     case Type::Array: {
         Value dup;
-        dup._type = Type::Array;
+        clearValue(&dup);
+        dup._type = v->type();
         dup._flag = 1;
         dup.value.imuInfo.selfOffset = buffer.size();
         int size = v->size();
         dup.value.imuInfo.sizeOrPos = size;
+        //_len: slots of the key table after the offsets, readers without it ignore it
+        uint32_t cap = 0;
+        if (v->type() == Type::Object && indexKeys && size > 0 && (size_t)size >= indexKeys) {
+            cap = 2;
+            while (cap < (uint32_t)size * 2) cap *= 2;
+        }
+        dup._len = cap;
         writeData((char*)(&dup), sizeof(Value));
 
-        int pos = buffer.size();
-        fillEmpty(sizeof(int32_t) * size);
-        for (auto p = v->begin(); p != v->end(); ++p) {
-            int32_t val_pos = buffer.size();
-            writeData((char*)(&val_pos), 4, pos);
-            pos += 4;
-
-            writeValue(*p);
-        }
+        EncodeFrame* frame = stack.push();
+        frame->it = v->begin();
+        frame->end = v->end();
+        frame->pos = buffer.size();
+        //Object: key and value offset, Array: value offset
+        fillEmpty(sizeof(int32_t) * size * (v->type() == Type::Object ? 2 : 1));
+        if (cap) writeKeyTable(v, size, cap);
         break;
     }
     default:
-        Value dup = *v;
+        Value dup;
+        clearValue(&dup);
+        dup._type = v->type();
+        if (v->_flag == 2) {
+            if (dup._type == Type::Integer) dup.set_int(v->as_int());
+            else dup.set_float(v->as_float());
+        }
+        else {
+            dup.value = v->value;
+        }
         writeData((char*)(&dup), sizeof(Value));
         break;
     }
+
+    while (!stack.empty()) {
+        EncodeFrame* top = stack.back();
+        if (!(top->it != top->end)) {
+            stack.pop();
+            continue;
+        }
+        v = *top->it;
+        const char* name = top->it.get_name();
+        ++top->it;
+        if (name) {
+            int32_t key_pos = strPos(name, strlen(name));
+            writeData((char*)(&key_pos), 4, top->pos);
+            top->pos += 4;
+        }
+
+        int32_t val_pos = buffer.size();
+        writeData((char*)(&val_pos), 4, top->pos);
+        top->pos += 4;
+        goto value;
+    }
 }
 
 std::vector<char> &JEncoder::encode(Value *v) {
+    //addresses of an earlier tree may be reused by this one
+    cache.clear();
     makeStrPool(v);
 
     writeData("JCXX", 4);
-    int32_t version = 3;
+    //3 plus key tables: every byte of a Value is written
+    int32_t version = 4;
     writeData((char*)(&version), 4);
 
     int header = 8;
@@ -150,6 +222,7 @@ std::vector<char> &JEncoder::encode(Value *v) {
         
         writeData(str.c_str(), n+1);
     }
+    cache.clear();
 
     int32_t jump = buffer.size();
     writeData((char*)(&jump), 4, header);
@@ -17,6 +17,7 @@
 #include <fstream>
 #include <cstring>
 #include "jparser.hpp"
+#include "jintern.hpp"
 
 namespace jsonc {
 
@@ -24,7 +25,12 @@ class JEncoder {
     std::map<const std::string, size_t> stringTable;
     std::vector<std::string> stringPool;
     std::vector<char> buffer;
+    //pool index, then buffer position, by address
+    PointerCache cache;
 public:    
+    /** objects with at least this many members get a key hash table, 0: none */
+    size_t indexKeys = JSONC_INDEX_MIN_KEYS;
+
     std::vector<char> &encode(Value* v);
 
     static Value *decode(char *buffer, int size) {
@@ -35,9 +41,12 @@ public:
     }
 private:
     void makeStrPool(Value *v);
+    void addStr(const char* str, size_t len);
+    size_t strPos(const char* str, size_t len);
     void writeValue(Value *v);
     void writeData(const char *data, int size, int at = -1);
     void fillEmpty(int size);
+    void writeKeyTable(Value* v, uint32_t size, uint32_t cap);
 };
 
 }//ns
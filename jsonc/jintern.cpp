@@ -0,0 +1,104 @@
+//
+// Licensed under the GNU LESSER GENERAL PUBLIC LICENSE version 3.0
+//  Created by Jed Young on 17/4/30.
+//  Copyright © 2017 chunquedong. All rights reserved.
+//
+
+
+#include "jintern.hpp"
+
+using namespace jsonc;
+
+const char* KeyTable::find(const char* key, size_t len) {
+    if (slots.empty()) return NULL;
+    uint32_t h = key_hash(key, len);
+    size_t mask = slots.size() - 1;
+    for (size_t i = h & mask; slots[i]; i = (i + 1) & mask) {
+        const char* k = slots[i];
+        const Header* head = (const Header*)k - 1;
+        if (head->hash == h && head->len == len && memcmp(k, key, len) == 0) return k;
+    }
+    return NULL;
+}
+
+const char* KeyTable::intern(const char* key, size_t len) {
+    //at most half full
+    if ((count + 1) * 2 > slots.size()) grow();
+    uint32_t h = key_hash(key, len);
+    size_t mask = slots.size() - 1;
+    size_t i = h & mask;
+    for (; slots[i]; i = (i + 1) & mask) {
+        const char* k = slots[i];
+        const Header* head = (const Header*)k - 1;
+        if (head->hash == h && head->len == len && memcmp(k, key, len) == 0) return k;
+    }
+    Header* head = (Header*)allocator.allocate_raw(sizeof(Header) + len + 1);
+    if (!head) return NULL;
+    head->hash = h;
+    head->len = (uint32_t)len;
+    char* k = (char*)(head + 1);
+    memcpy(k, key, len);
+    k[len] = 0;
+    slots[i] = k;
+    ++count;
+    return k;
+}
+
+void KeyTable::grow() {
+    std::vector<const char*> old;
+    old.swap(slots);
+    slots.resize(old.empty() ? 64 : old.size() * 2, NULL);
+    size_t mask = slots.size() - 1;
+    for (const char* k : old) {
+        if (!k) continue;
+        size_t i = hash_of(k) & mask;
+        while (slots[i]) i = (i + 1) & mask;
+        slots[i] = k;
+    }
+}
+
+void KeyTable::clear() {
+    slots.clear();
+    count = 0;
+    allocator.reset();
+}
+
+namespace {
+struct InternFrame {
+    JsonIterator it;
+    JsonIterator end;
+};
+}
+
+void jsonc::intern_keys(Value* root, KeyTable* table) {
+    if (!root) return;
+    FrameStack<InternFrame> stack;
+    Value* v = root;
+
+value:
+    //v3 containers point into a read-only buffer
+    if ((v->type() == Type::Array || v->type() == Type::Object) && v->_flag != 1) {
+        InternFrame* frame = stack.push();
+        frame->it = v->begin();
+        frame->end = v->end();
+    }
+
+    while (!stack.empty()) {
+        InternFrame* top = stack.back();
+        if (!(top->it != top->end)) {
+            stack.pop();
+            continue;
+        }
+        JsonIterator& it = top->it;
+        v = *it;
+        const char* name = it.get_name();
+        if (name) {
+            const char* key = table->intern(name);
+            //tape members are a key entry then the value, tree members are nodes
+            if (it.parent->_flag == 3) it.pos->value.str = (char*)key;
+            else ((JsonNode*)v)->name = key;
+        }
+        ++it;
+        goto value;
+    }
+}
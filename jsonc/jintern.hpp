@@ -0,0 +1,102 @@
+//
+// Licensed under the GNU LESSER GENERAL PUBLIC LICENSE version 3.0
+//  Created by Jed Young on 17/4/30.
+//  Copyright © 2017 chunquedong. All rights reserved.
+//
+
+
+#ifndef jintern_hpp
+#define jintern_hpp
+
+#include "jvalue.hpp"
+
+namespace jsonc {
+
+    /**
+    * Symbol table of object keys. Each distinct key is stored once and
+    * intern() always returns the same pointer for it, so keys from the
+    * table compare by pointer. Set JsonParser::keyTable to intern the keys
+    * of every document parsed with it, the table must outlive the trees.
+    * Not thread safe.
+    *
+    *   KeyTable keys;
+    *   parser.keyTable = &keys;
+    *   const char* id = keys.intern("id");
+    *   for (...) record->get_interned(id);
+    */
+    class KeyTable {
+        struct Header {
+            uint32_t hash;
+            uint32_t len;
+        };
+        JsonAllocator allocator;
+        //canonical keys, NULL: empty
+        std::vector<const char*> slots;
+        size_t count;
+
+        void grow();
+    public:
+        KeyTable() : count(0) {}
+
+        /** the canonical copy of len bytes at key */
+        const char* intern(const char* key, size_t len);
+        const char* intern(const char* key) { return intern(key, strlen(key)); }
+
+        /** the canonical copy, NULL if the key was never interned */
+        const char* find(const char* key, size_t len);
+
+        /** distinct keys */
+        size_t size() { return count; }
+
+        /** key_hash of a key returned by intern */
+        static uint32_t hash_of(const char* key) { return ((const Header*)key - 1)->hash; }
+        /** length of a key returned by intern */
+        static size_t length_of(const char* key) { return ((const Header*)key - 1)->len; }
+
+        /** forget all keys, the pointers handed out become invalid */
+        void clear();
+    private:
+        KeyTable(const KeyTable&);
+        KeyTable& operator=(const KeyTable&);
+    };
+
+    /**
+    * Direct mapped cache from a string address to a number, for writers
+    * that meet the same interned keys over and over. A miss costs a
+    * compare, colliding entries overwrite each other.
+    */
+    class PointerCache {
+        static const int Size = 256;
+        const char* keys[Size];
+        size_t values[Size];
+
+        static size_t slot(const char* p) {
+            uintptr_t a = (uintptr_t)p;
+            return ((a >> 3) ^ (a >> 11)) & (Size - 1);
+        }
+    public:
+        PointerCache() { clear(); }
+        void clear() { memset(keys, 0, sizeof(keys)); }
+
+        bool find(const char* p, size_t* value) {
+            size_t i = slot(p);
+            if (keys[i] != p) return false;
+            *value = values[i];
+            return true;
+        }
+        void put(const char* p, size_t value) {
+            size_t i = slot(p);
+            keys[i] = p;
+            values[i] = value;
+        }
+    };
+
+    /**
+    * Replace the object keys of root with their canonical copies in table.
+    * For trees built without JsonParser::keyTable. v3 buffers are read-only
+    * and are skipped.
+    */
+    void intern_keys(Value* root, KeyTable* table);
+}
+
+#endif /* jintern_hpp */
@@ -0,0 +1,348 @@
+//
+// Licensed under the GNU LESSER GENERAL PUBLIC LICENSE version 3.0
+//  Created by Jed Young on 17/4/30.
+//  Copyright © 2017 chunquedong. All rights reserved.
+//
+
+
+#include "jlazy.hpp"
+#include "jscan.hpp"
+#include "jnumber.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace jsonc;
+
+/////////////////////////////////////////////////////////////////
+// LazyDocument
+/////////////////////////////////////////////////////////////////
+
+LazyValue LazyDocument::parse(const char* src, size_t len) {
+    this->src = src;
+    srcEnd = src + len;
+    error[0] = 0;
+    const char* p = skip_space(src, srcEnd);
+    if (p >= srcEnd) {
+        fail("Unexpected end of stream", p);
+        return LazyValue();
+    }
+    return LazyValue(this, p);
+}
+
+void LazyDocument::fail(const char* msg, const char* p) {
+    if (!error[0]) {
+        //msg may be a parser error of 128 bytes, keep room for the offset
+        snprintf(error, 128, "%.100s at offset %llu", msg, (unsigned long long)(p - src));
+    }
+}
+
+const char* LazyDocument::skip(const char* p) {
+    const char* e = skip_value(p, srcEnd);
+    if (!e) fail("Malformed value", p);
+    return e;
+}
+
+const char* LazyDocument::valueAt(const char* keyPos) {
+    const char* p = skip_string(keyPos, srcEnd);
+    if (!p) {
+        fail("Unexpected end of stream in string", keyPos);
+        return NULL;
+    }
+    p = skip_space(p, srcEnd);
+    if (p >= srcEnd || *p != ':') {
+        fail("':' Expected", p);
+        return NULL;
+    }
+    p = skip_space(p + 1, srcEnd);
+    if (p >= srcEnd) {
+        fail("Unexpected end of stream", p);
+        return NULL;
+    }
+    return p;
+}
+
+char* LazyDocument::copyStr(const char* p) {
+    const char* e = skip_string(p, srcEnd);
+    if (!e) {
+        fail("Unexpected end of stream in string", p);
+        return NULL;
+    }
+    //with both quotes
+    size_t n = e - p;
+    char* buf = (char*)allocator->allocate_raw(n + 1);
+    if (!memchr(p + 1, '\\', n - 2)) {
+        memcpy(buf, p + 1, n - 2);
+        buf[n - 2] = 0;
+        return buf;
+    }
+    memcpy(buf, p, n);
+    buf[n] = 0;
+    Value* v = parser.parse(buf);
+    if (!v) {
+        fail(parser.get_error(), p);
+        return NULL;
+    }
+    return v->value.str;
+}
+
+const char* LazyDocument::keyAt(const char* p, size_t* len) {
+    const char* e = skip_string(p, srcEnd);
+    if (!e) {
+        fail("Unexpected end of stream in string", p);
+        return NULL;
+    }
+    const char* key = p + 1;
+    size_t n = e - key - 1;
+    if (!memchr(key, '\\', n)) {
+        *len = n;
+        return key;
+    }
+    //unescaping never makes a string longer
+    scratch.resize(n + 1);
+    n = unescape_str(key, n, &scratch[0]);
+    if (n == (size_t)-1) {
+        fail("Bad escape in string", p);
+        return NULL;
+    }
+    *len = n;
+    return scratch.data();
+}
+
+/////////////////////////////////////////////////////////////////
+// LazyValue
+/////////////////////////////////////////////////////////////////
+
+Type LazyValue::type() {
+    if (!pos) return Type::Null;
+    switch (*pos) {
+    case '"': return Type::String;
+    case '{': return Type::Object;
+    case '[': return Type::Array;
+    case 't':
+    case 'f': return Type::Boolean;
+    case 'n': return Type::Null;
+    default: {
+        Value v;
+        if (!parse_number(pos, doc->srcEnd, &v)) return Type::Null;
+        return v.type();
+    }
+    }
+}
+
+LazyValue LazyValue::get(const char* name) {
+    if (!pos || *pos != '{') return LazyValue();
+    const char* end = doc->srcEnd;
+    size_t nameLen = strlen(name);
+    const char* first = pos + 1;
+    const char* start = cursor ? cursor : first;
+    const char* p = start;
+    bool wrapped = false;
+    while (true) {
+        p = skip_space(p, end);
+        if (p < end && *p == ',') {
+            p = skip_space(p + 1, end);
+        }
+        else if (p < end && *p == '}') {
+            if (wrapped || start == first) return LazyValue();
+            wrapped = true;
+            p = first;
+            continue;
+        }
+        if (wrapped && p >= start) return LazyValue();
+        if (p >= end || *p != '"') {
+            doc->fail("object key must be string", p);
+            return LazyValue();
+        }
+
+        const char* val = doc->valueAt(p);
+        if (!val) return LazyValue();
+        const char* next = doc->skip(val);
+        if (!next) return LazyValue();
+
+        const char* key = p + 1;
+        size_t keyLen = skip_string(p, end) - key - 1;
+        if (keyLen >= nameLen && memchr(key, '\\', keyLen)) key = doc->keyAt(p, &keyLen);
+        if (key && keyLen == nameLen && memcmp(key, name, nameLen) == 0) {
+            cursor = next;
+            return LazyValue(doc, val);
+        }
+        p = next;
+    }
+}
+
+LazyValue LazyValue::at(size_t i) {
+    if (!pos || *pos != '[') return LazyValue();
+    size_t k = 0;
+    for (LazyIterator it = begin(); it != end(); ++it, ++k) {
+        if (k == i) return *it;
+    }
+    return LazyValue();
+}
+
+size_t LazyValue::size() {
+    if (!pos || (*pos != '[' && *pos != '{')) return 0;
+    size_t n = 0;
+    for (LazyIterator it = begin(); it != end(); ++it) {
+        ++n;
+    }
+    return n;
+}
+
+bool LazyValue::scalar(Value& out) {
+    if (!pos) return false;
+    const char* end = doc->srcEnd;
+    switch (*pos) {
+    case '"': {
+        char* str = doc->copyStr(pos);
+        if (!str) return false;
+        out.set_str(str);
+        return true;
+    }
+    case 't':
+        if (end - pos >= 4 && memcmp(pos, "true", 4) == 0) {
+            out.set_bool(true);
+            return true;
+        }
+        break;
+    case 'f':
+        if (end - pos >= 5 && memcmp(pos, "false", 5) == 0) {
+            out.set_bool(false);
+            return true;
+        }
+        break;
+    case 'n':
+        if (end - pos >= 4 && memcmp(pos, "null", 4) == 0) {
+            out.set_type(Type::Null);
+            return true;
+        }
+        break;
+    case '{':
+    case '[':
+        return false;
+    default:
+        if (parse_number(pos, end, &out)) return true;
+        break;
+    }
+    doc->fail("Unexpected token", pos);
+    return false;
+}
+
+const char* LazyValue::as_str(const char* defVal) {
+    Value v;
+    if (!pos || *pos != '"' || !scalar(v)) return defVal;
+    return v.as_str();
+}
+
+int64_t LazyValue::as_int(int64_t defVal) {
+    Value v;
+    if (!scalar(v)) return defVal;
+    return v.as_int();
+}
+
+double LazyValue::as_float(double defVal) {
+    Value v;
+    if (!scalar(v)) return defVal;
+    return v.as_float();
+}
+
+bool LazyValue::as_bool(bool defVal) {
+    Value v;
+    if (!scalar(v)) return defVal;
+    return v.as_bool();
+}
+
+Value* LazyValue::materialize() {
+    if (!pos) return NULL;
+    const char* e = doc->skip(pos);
+    if (!e) return NULL;
+    size_t n = e - pos;
+    char* buf = (char*)doc->allocator->allocate_raw(n + 1);
+    memcpy(buf, pos, n);
+    buf[n] = 0;
+    Value* v = doc->parser.parse(buf);
+    if (!v || doc->parser.get_error()[0]) {
+        doc->fail(doc->parser.get_error(), pos);
+        return NULL;
+    }
+    return v;
+}
+
+LazyIterator LazyValue::begin() {
+    LazyIterator it;
+    it.doc = doc;
+    it.pos = NULL;
+    it.isObject = pos && *pos == '{';
+    if (pos && (*pos == '{' || *pos == '[')) {
+        const char* p = skip_space(pos + 1, doc->srcEnd);
+        if (p >= doc->srcEnd) {
+            doc->fail("Unexpected end of stream", p);
+        }
+        else if (*p != '}' && *p != ']') {
+            it.pos = p;
+        }
+    }
+    return it;
+}
+
+LazyIterator LazyValue::end() {
+    LazyIterator it;
+    it.doc = doc;
+    it.pos = NULL;
+    it.isObject = pos && *pos == '{';
+    return it;
+}
+
+/////////////////////////////////////////////////////////////////
+// LazyIterator
+/////////////////////////////////////////////////////////////////
+
+void LazyIterator::operator++() {
+    const char* p = pos;
+    if (isObject) {
+        p = doc->valueAt(p);
+        if (!p) {
+            pos = NULL;
+            return;
+        }
+    }
+    p = doc->skip(p);
+    if (!p) {
+        pos = NULL;
+        return;
+    }
+    p = skip_space(p, doc->srcEnd);
+    if (p < doc->srcEnd && *p == ',') {
+        pos = skip_space(p + 1, doc->srcEnd);
+        if (pos >= doc->srcEnd) {
+            doc->fail("Unexpected end of stream", pos);
+            pos = NULL;
+        }
+        return;
+    }
+    if (p >= doc->srcEnd || *p != (isObject ? '}' : ']')) {
+        doc->fail("Unexpected token", p);
+    }
+    pos = NULL;
+}
+
+LazyValue LazyIterator::operator*() const {
+    if (!isObject) return LazyValue(doc, pos);
+    return LazyValue(doc, doc->valueAt(pos));
+}
+
+const char* LazyIterator::get_name(size_t* len) const {
+    if (!isObject || *pos != '"') return NULL;
+    return doc->keyAt(pos, len);
+}
+
+const char* LazyIterator::get_name() const {
+    size_t len;
+    const char* key = get_name(&len);
+    if (!key) return NULL;
+    std::string& scratch = doc->scratch;
+    //an escaped key is already there
+    if (key == scratch.data()) scratch.resize(len);
+    else scratch.assign(key, len);
+    return scratch.c_str();
+}
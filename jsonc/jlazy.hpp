@@ -0,0 +1,111 @@
+//
+// Licensed under the GNU LESSER GENERAL PUBLIC LICENSE version 3.0
+//  Created by Jed Young on 17/4/30.
+//  Copyright © 2017 chunquedong. All rights reserved.
+//
+
+
+#ifndef jlazy_hpp
+#define jlazy_hpp
+
+#include "jparser.hpp"
+#include <string>
+
+namespace jsonc {
+
+    class LazyDocument;
+    struct LazyIterator;
+
+    /*
+    * Cursor into the raw text of a LazyDocument. Nothing is parsed until a
+    * value is read, and unread subtrees are skipped by bracket matching.
+    */
+    class LazyValue {
+        friend class LazyDocument;
+        friend struct LazyIterator;
+        LazyDocument* doc;
+        const char* pos;
+        //resume point of the last get(), lookups in field order stay linear
+        const char* cursor;
+    public:
+        LazyValue() : doc(NULL), pos(NULL), cursor(NULL) {}
+        LazyValue(LazyDocument* doc, const char* pos) : doc(doc), pos(pos), cursor(NULL) {}
+
+        bool exists() const { return pos != NULL; }
+        Type type();
+
+        LazyValue get(const char* name);
+        LazyValue at(size_t i);
+        size_t size();
+
+        const char* as_str(const char* defVal = "");
+        int64_t as_int(int64_t defVal = 0);
+        double as_float(double defVal = 0);
+        bool as_bool(bool defVal = false);
+
+        int64_t get_int(const char* name, int64_t defval = 0) { return get(name).as_int(defval); }
+        double get_float(const char* name, double defval = 0) { return get(name).as_float(defval); }
+        bool get_bool(const char* name, bool defval = false) { return get(name).as_bool(defval); }
+        const char* get_str(const char* name, const char* defval = "") { return get(name).as_str(defval); }
+
+        /**
+        * Parse this subtree into JsonNodes in the document allocator.
+        */
+        Value* materialize();
+
+        LazyIterator begin();
+        LazyIterator end();
+    private:
+        bool scalar(Value& out);
+    };
+
+    struct LazyIterator {
+        LazyDocument* doc;
+        //key of the current member for objects, else the element
+        const char* pos;
+        bool isObject;
+
+        void operator++();
+        bool operator!=(const LazyIterator& x) const { return pos != x.pos; }
+        LazyValue operator*() const;
+        /** key of the current member, valid until the next get_name call on the document */
+        const char* get_name() const;
+        /**
+        * Same without the NUL: plain keys point into the text, escaped ones
+        * are decoded into a buffer of the document.
+        */
+        const char* get_name(size_t* len) const;
+    };
+
+    class LazyDocument {
+        friend class LazyValue;
+        friend struct LazyIterator;
+        const char* src;
+        const char* srcEnd;
+        JsonAllocator* allocator;
+        JsonParser parser;
+        //decoded key, reused by every lookup
+        std::string scratch;
+        char error[128];
+    public:
+        LazyDocument(JsonAllocator* allocator) : src(NULL), srcEnd(NULL), allocator(allocator), parser(allocator) {
+            error[0] = 0;
+        }
+
+        /**
+        * The text is only read, never modified, and must outlive the values.
+        */
+        LazyValue parse(const char* src, size_t len);
+
+        const char* get_error() { return error; }
+
+    private:
+        const char* skip(const char* p);
+        const char* valueAt(const char* keyPos);
+        char* copyStr(const char* p);
+        const char* keyAt(const char* p, size_t* len);
+        void fail(const char* msg, const char* p);
+    };
+}
+
+#endif /* jlazy_hpp */
@@ -0,0 +1,211 @@
+//
+// Licensed under the GNU LESSER GENERAL PUBLIC LICENSE version 3.0
+//  Created by Jed Young on 17/4/30.
+//  Copyright © 2017 chunquedong. All rights reserved.
+//
+
+
+#include "jlines.hpp"
+#include "jsplit.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace jsonc;
+
+namespace {
+struct Shard {
+    size_t begin;
+    size_t end;
+    std::vector<Value*> records;
+    char error[128];
+};
+}
+
+/**
+* First newline at or after pos that is not inside a string.
+*/
+static size_t findRecordEnd(const char* src, size_t len, size_t pos, bool inString) {
+    bool escaped = is_escaped(src, pos);
+    for (; pos < len; ++pos) {
+        char c = src[pos];
+        if (inString) {
+            if (escaped) escaped = false;
+            else if (c == '\\') escaped = true;
+            else if (c == '"') inString = false;
+        }
+        else if (c == '"') {
+            inString = true;
+        }
+        else if (c == '\n') {
+            return pos;
+        }
+    }
+    return len;
+}
+
+static void parseShard(char* src, Shard& shard, JsonAllocator* allocator) {
+    JsonParser parser(allocator);
+    char* p = src + shard.begin;
+    shard.error[0] = 0;
+    if (shard.begin >= shard.end) return;
+    while (true) {
+        while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') ++p;
+        if (*p == 0) break;
+        Value* v = parser.parse(p);
+        if (!v || parser.get_error()[0]) {
+            snprintf(shard.error, 128, "%s", parser.get_error());
+            return;
+        }
+        shard.records.push_back(v);
+        p = parser.get_end();
+        while (*p == ' ' || *p == '\t' || *p == '\r') ++p;
+        if (*p != '\n' && *p != 0) {
+            snprintf(shard.error, 128, "Unexpected token '%c' after record", *p);
+            return;
+        }
+    }
+}
+
+JsonLinesParser::~JsonLinesParser() {
+    clear();
+    unmap();
+}
+
+void JsonLinesParser::clear() {
+    for (size_t i = 0; i < allocators.size(); ++i) {
+        delete allocators[i];
+    }
+    allocators.clear();
+    records.clear();
+    error[0] = 0;
+}
+
+bool JsonLinesParser::parse(char* buf, size_t len) {
+    clear();
+    int n = thread_count(len, maxThreads, minShardSize);
+
+    //split at the first record boundary after each equal chunk
+    std::vector<size_t> starts(n);
+    for (int i = 0; i < n; ++i) {
+        starts[i] = len / n * i;
+    }
+    std::vector<char> inString;
+    string_states(buf, len, starts, inString);
+
+    std::vector<Shard> shards(n);
+    shards[0].begin = 0;
+    for (int i = 1; i < n; ++i) {
+        size_t end = findRecordEnd(buf, len, starts[i], inString[i] != 0);
+        if (end < shards[i - 1].begin) {
+            //a long record of the shard before already passed this newline,
+            //the previous shard stays empty and this one starts in its place
+            shards[i - 1].end = shards[i - 1].begin;
+            shards[i].begin = shards[i - 1].begin;
+            continue;
+        }
+        shards[i - 1].end = end;
+        shards[i].begin = end < len ? end + 1 : len;
+    }
+    shards[n - 1].end = len;
+
+    //a shard never reads past its own terminator
+    for (int i = 0; i < n - 1; ++i) {
+        if (shards[i].begin < shards[i].end && shards[i].end < len) buf[shards[i].end] = 0;
+    }
+
+    for (int i = 0; i < n; ++i) {
+        allocators.push_back(new JsonAllocator());
+    }
+    parallel_run(n, [&](int i) {
+        parseShard(buf, shards[i], allocators[i]);
+    });
+
+    size_t total = 0;
+    for (int i = 0; i < n; ++i) {
+        if (shards[i].error[0]) {
+            //the record number always fits, the message may be cut
+            snprintf(error, 128, "record %llu: %.100s", (unsigned long long)(total + shards[i].records.size()), shards[i].error);
+            return false;
+        }
+        total += shards[i].records.size();
+    }
+    records.reserve(total);
+    for (int i = 0; i < n; ++i) {
+        records.insert(records.end(), shards[i].records.begin(), shards[i].records.end());
+    }
+    return true;
+}
+
+void JsonLinesParser::unmap() {
+    if (!mapped) return;
+#ifdef _WIN32
+    free(mapped);
+#else
+    munmap(mapped, mappedSize);
+#endif
+    mapped = NULL;
+    mappedSize = 0;
+}
+
+bool JsonLinesParser::parse_file(const char* path) {
+    clear();
+    unmap();
+#ifdef _WIN32
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        snprintf(error, 128, "can not open %s", path);
+        return false;
+    }
+    fseek(file, 0, SEEK_END);
+    long len = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    mapped = (char*)malloc(len + 1);
+    size_t n = fread(mapped, 1, len, file);
+    fclose(file);
+    mapped[n] = 0;
+    mappedSize = n + 1;
+    return parse(mapped, n);
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        snprintf(error, 128, "can not open %s", path);
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        snprintf(error, 128, "can not stat %s", path);
+        return false;
+    }
+    size_t len = (size_t)st.st_size;
+    //one extra zero page behind the file for the terminator
+    mappedSize = len + 1;
+    void* area = mmap(NULL, mappedSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (area == MAP_FAILED) {
+        close(fd);
+        mappedSize = 0;
+        snprintf(error, 128, "can not map %s", path);
+        return false;
+    }
+    if (len && mmap(area, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        munmap(area, mappedSize);
+        close(fd);
+        mappedSize = 0;
+        snprintf(error, 128, "can not map %s", path);
+        return false;
+    }
+    close(fd);
+    mapped = (char*)area;
+    madvise(mapped, mappedSize, MADV_SEQUENTIAL);
+    return parse(mapped, len);
+#endif
+}
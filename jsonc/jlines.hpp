@@ -0,0 +1,63 @@
+//
+// Licensed under the GNU LESSER GENERAL PUBLIC LICENSE version 3.0
+//  Created by Jed Young on 17/4/30.
+//  Copyright © 2017 chunquedong. All rights reserved.
+//
+
+
+#ifndef jlines_hpp
+#define jlines_hpp
+
+#include "jparser.hpp"
+#include <vector>
+
+namespace jsonc {
+
+    /*
+    * Parse newline delimited JSON (JSON Lines) on several threads.
+    * The buffer is split at record boundaries, each shard is parsed in place
+    * into its own JsonAllocator, and records are returned in input order.
+    */
+    class JsonLinesParser {
+        std::vector<JsonAllocator*> allocators;
+        std::vector<Value*> records;
+        char error[128];
+        char* mapped;
+        size_t mappedSize;
+    public:
+        /** 0: one thread per core */
+        int maxThreads = 0;
+        /** smallest shard handed to a thread */
+        size_t minShardSize = 256 * 1024;
+
+        JsonLinesParser() : mapped(NULL), mappedSize(0) {
+            error[0] = 0;
+        }
+        ~JsonLinesParser();
+
+        /**
+        * buf must be NUL terminated at len and outlive the records.
+        * Returns false on the first malformed record.
+        */
+        bool parse(char* buf, size_t len);
+
+        /**
+        * Map the file copy-on-write and parse it. The file is not modified.
+        */
+        bool parse_file(const char* path);
+
+        size_t size() { return records.size(); }
+        Value* get(size_t i) { return records[i]; }
+        std::vector<Value*>& get_records() { return records; }
+        const char* get_error() { return error; }
+
+    private:
+        void clear();
+        void unmap();
+
+        JsonLinesParser(const JsonLinesParser&);
+        JsonLinesParser& operator=(const JsonLinesParser&);
+    };
+}
+
+#endif /* jlines_hpp */
@@ -0,0 +1,174 @@
+//
+// Licensed under the GNU LESSER GENERAL PUBLIC LICENSE version 3.0
+//  Created by Jed Young on 17/4/30.
+//  Copyright © 2017 chunquedong. All rights reserved.
+//
+
+
+#include "jmapped.hpp"
+#include "jcompress.hpp"
+#include "jencoder.hpp"
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace jsonc;
+
+DocFormat MappedDocument::detect(const char* data, size_t len) {
+    if (len >= 8 && memcmp(data, "JCXX", 4) == 0) {
+        int32_t version;
+        memcpy(&version, data + 4, 4);
+        if (version == 1) return DocFormat::JCXX1;
+        if ((version == 3 || version == 4) && len >= 12) return DocFormat::JCXX3;
+        return DocFormat::Unknown;
+    }
+    return DocFormat::Json;
+}
+
+Value* MappedDocument::open(const char* path, MapAccess access) {
+    close();
+    if (!map(path)) return NULL;
+    format = detect(data, length);
+
+    switch (format) {
+    case DocFormat::Json: {
+        //one forward pass, strings are copied out of the mapping. The mapping
+        //has no terminator, parse(data, len) never reads past length
+        advise(MapAccess::Sequential);
+        JsonParser parser(&allocator);
+        root = parser.parse(data, length);
+        if (!root) snprintf(error, 128, "%s", parser.get_error());
+        break;
+    }
+    case DocFormat::JCXX1: {
+        if (length > INT32_MAX) {
+            snprintf(error, 128, "file too large for JCXX v1: %s", path);
+            break;
+        }
+        advise(MapAccess::Sequential);
+        //strings point into the string pool of the mapping
+        JCReader reader(data, (int)length, &allocator);
+        root = reader.read();
+        if (!root) snprintf(error, 128, "bad JCXX v1 data: %s", path);
+        break;
+    }
+    case DocFormat::JCXX3:
+        root = length <= INT32_MAX ? JEncoder::decode(data, (int)length) : NULL;
+        if (!root) snprintf(error, 128, "bad JCXX v3 data: %s", path);
+        break;
+    default: {
+        int32_t version;
+        memcpy(&version, data + 4, 4);
+        snprintf(error, 128, "unsupport version:%d", version);
+        break;
+    }
+    }
+    advise(access);
+    return root;
+}
+
+#ifdef _WIN32
+
+bool MappedDocument::map(const char* path) {
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        snprintf(error, 128, "can not open %s", path);
+        return false;
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+        CloseHandle(file);
+        snprintf(error, 128, "empty file %s", path);
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (!mapping) {
+        snprintf(error, 128, "can not map %s", path);
+        return false;
+    }
+    data = (char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (!data) {
+        snprintf(error, 128, "can not map %s", path);
+        return false;
+    }
+    length = (size_t)size.QuadPart;
+    return true;
+}
+
+void MappedDocument::advise(MapAccess access) {
+    if (access == MapAccess::WillNeed) {
+        WIN32_MEMORY_RANGE_ENTRY range;
+        range.VirtualAddress = data;
+        range.NumberOfBytes = length;
+        PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+    }
+}
+
+void MappedDocument::close() {
+    if (data) UnmapViewOfFile(data);
+    data = NULL;
+    length = 0;
+    root = NULL;
+    format = DocFormat::Unknown;
+    error[0] = 0;
+    JsonAllocator empty;
+    allocator.swap(empty);
+}
+
+#else
+
+bool MappedDocument::map(const char* path) {
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) {
+        snprintf(error, 128, "can not open %s", path);
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        ::close(fd);
+        snprintf(error, 128, "empty file %s", path);
+        return false;
+    }
+    void* area = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (area == MAP_FAILED) {
+        snprintf(error, 128, "can not map %s", path);
+        return false;
+    }
+    data = (char*)area;
+    length = (size_t)st.st_size;
+    return true;
+}
+
+void MappedDocument::advise(MapAccess access) {
+    int advice = MADV_NORMAL;
+    switch (access) {
+    case MapAccess::Sequential: advice = MADV_SEQUENTIAL; break;
+    case MapAccess::Random: advice = MADV_RANDOM; break;
+    case MapAccess::WillNeed: advice = MADV_WILLNEED; break;
+    }
+    madvise(data, length, advice);
+}
+
+void MappedDocument::close() {
+    if (data) munmap(data, length);
+    data = NULL;
+    length = 0;
+    root = NULL;
+    format = DocFormat::Unknown;
+    error[0] = 0;
+    JsonAllocator empty;
+    allocator.swap(empty);
+}
+
+#endif
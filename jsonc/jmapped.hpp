@@ -0,0 +1,78 @@
+//
+// Licensed under the GNU LESSER GENERAL PUBLIC LICENSE version 3.0
+//  Created by Jed Young on 17/4/30.
+//  Copyright © 2017 chunquedong. All rights reserved.
+//
+
+
+#ifndef jmapped_hpp
+#define jmapped_hpp
+
+#include "jparser.hpp"
+
+namespace jsonc {
+
+    enum class DocFormat : uint8_t {
+        Unknown,
+        /** JSON text */
+        Json,
+        /** JCXX version 1, JCWriter */
+        JCXX1,
+        /** JCXX version 3 or 4, JEncoder */
+        JCXX3,
+    };
+
+    /** Access pattern hint for the mapped pages */
+    enum class MapAccess : uint8_t {
+        Sequential,
+        Random,
+        /** prefault the whole file */
+        WillNeed,
+    };
+
+    /*
+    * Map a file read-only and load it as a document. The format is detected
+    * from the header. JCXX v3 is used in place without any decoding, so the
+    * pages are shared with other processes through the page cache.
+    * The root stays valid until close() or destruction.
+    */
+    class MappedDocument {
+        char* data;
+        size_t length;
+        DocFormat format;
+        Value* root;
+        JsonAllocator allocator;
+        char error[128];
+    public:
+        MappedDocument() : data(NULL), length(0), format(DocFormat::Unknown), root(NULL) {
+            error[0] = 0;
+        }
+        ~MappedDocument() { close(); }
+
+        /**
+        * Returns NULL on error, see get_error().
+        */
+        Value* open(const char* path, MapAccess access = MapAccess::Sequential);
+        void close();
+
+        Value* get_root() { return root; }
+        DocFormat get_format() { return format; }
+        const char* get_data() { return data; }
+        size_t get_size() { return length; }
+        const char* get_error() { return error; }
+
+        /**
+        * Format of a buffer, judged by its header.
+        */
+        static DocFormat detect(const char* data, size_t len);
+
+    private:
+        bool map(const char* path);
+        void advise(MapAccess access);
+
+        MappedDocument(const MappedDocument&);
+        MappedDocument& operator=(const MappedDocument&);
+    };
+}
+
+#endif /* jmapped_hpp */
@@ -0,0 +1,183 @@
+//
+// Licensed under the GNU LESSER GENERAL PUBLIC LICENSE version 3.0
+//  Created by Jed Young on 17/4/30.
+//  Copyright © 2017 chunquedong. All rights reserved.
+//
+
+
+#include "jmemory.hpp"
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+#endif
+
+using namespace jsonc;
+
+#define JSON_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+/////////////////////////////////////////////////////////////////
+// PageSource
+/////////////////////////////////////////////////////////////////
+
+size_t PageSource::mappedSize(size_t size) {
+    size_t page;
+    if (hugePages != HugePages::None) {
+        page = JSON_HUGE_PAGE_SIZE;
+#ifdef _WIN32
+        if (hugePages == HugePages::Explicit && GetLargePageMinimum() > page) page = GetLargePageMinimum();
+#endif
+    }
+    else {
+#ifdef _WIN32
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        page = info.dwPageSize;
+#else
+        page = (size_t)sysconf(_SC_PAGESIZE);
+#endif
+    }
+    return (size + page - 1) / page * page;
+}
+
+#ifdef _WIN32
+
+static void* winAlloc(size_t len, DWORD flags, int numaNode) {
+    flags |= MEM_RESERVE | MEM_COMMIT;
+    if (numaNode >= 0) {
+        return VirtualAllocExNuma(GetCurrentProcess(), NULL, len, flags, PAGE_READWRITE, (DWORD)numaNode);
+    }
+    return VirtualAlloc(NULL, len, flags, PAGE_READWRITE);
+}
+
+void* PageSource::alloc_block(size_t size) {
+    size_t len = mappedSize(size);
+    void* p = NULL;
+    //large pages need SeLockMemoryPrivilege, fall back to normal pages
+    if (hugePages == HugePages::Explicit) p = winAlloc(len, MEM_LARGE_PAGES, numaNode);
+    if (!p) p = winAlloc(len, 0, numaNode);
+    return p;
+}
+
+void PageSource::free_block(void* block, size_t size) {
+    VirtualFree(block, 0, MEM_RELEASE);
+}
+
+#else
+
+void* PageSource::alloc_block(size_t size) {
+    size_t len = mappedSize(size);
+    void* p = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    //reserved huge pages may be exhausted, fall back to transparent ones
+    if (hugePages == HugePages::Explicit) {
+        p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    }
+#endif
+    if (p == MAP_FAILED) {
+        p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) return NULL;
+#ifdef MADV_HUGEPAGE
+        if (hugePages != HugePages::None) madvise(p, len, MADV_HUGEPAGE);
+#endif
+    }
+
+#if defined(__linux__) && defined(SYS_mbind)
+    //set the policy before the first touch, pages are placed when faulted in
+    if (numaNode != NumaAny) {
+        const int mpolPreferred = 1;
+        const int mpolLocal = 4;
+        unsigned long mask = 0;
+        if (numaNode >= 0 && numaNode < (int)(sizeof(mask) * 8)) {
+            mask = 1UL << numaNode;
+            syscall(SYS_mbind, p, len, mpolPreferred, &mask, sizeof(mask) * 8 + 1, 0);
+        }
+        else if (numaNode == NumaLocal) {
+            syscall(SYS_mbind, p, len, mpolLocal, NULL, 0, 0);
+        }
+    }
+#endif
+    return p;
+}
+
+void PageSource::free_block(void* block, size_t size) {
+    munmap(block, mappedSize(size));
+}
+
+#endif
+
+/////////////////////////////////////////////////////////////////
+// BlockPool
+/////////////////////////////////////////////////////////////////
+
+//class c holds blocks of 4096 << c bytes
+static int sizeClass(size_t size, int classCount) {
+    int c = 0;
+    while (((size_t)4096 << c) < size) {
+        if (++c == classCount) break;
+    }
+    return c;
+}
+
+BlockPool::~BlockPool() {
+    trim();
+}
+
+BlockPool& BlockPool::global() {
+    //never destroyed, allocators in static objects may still free into it
+    static BlockPool* pool = new BlockPool();
+    return *pool;
+}
+
+void* BlockPool::alloc_block(size_t size) {
+    int c = sizeClass(size, ClassCount);
+    if (c >= ClassCount) {
+        return upstream ? upstream->alloc_block(size) : malloc(size);
+    }
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        std::vector<void*>& list = freeBlocks[c];
+        if (!list.empty()) {
+            void* p = list.back();
+            list.pop_back();
+            retained -= (size_t)4096 << c;
+            return p;
+        }
+    }
+    size = (size_t)4096 << c;
+    return upstream ? upstream->alloc_block(size) : malloc(size);
+}
+
+void BlockPool::free_block(void* block, size_t size) {
+    int c = sizeClass(size, ClassCount);
+    if (c < ClassCount) {
+        size = (size_t)4096 << c;
+        std::lock_guard<std::mutex> guard(lock);
+        if (retained + size <= maxRetained) {
+            freeBlocks[c].push_back(block);
+            retained += size;
+            return;
+        }
+    }
+    if (upstream) upstream->free_block(block, size);
+    else free(block);
+}
+
+void BlockPool::trim() {
+    std::lock_guard<std::mutex> guard(lock);
+    for (int c = 0; c < ClassCount; ++c) {
+        size_t size = (size_t)4096 << c;
+        for (void* p : freeBlocks[c]) {
+            if (upstream) upstream->free_block(p, size);
+            else free(p);
+        }
+        freeBlocks[c].clear();
+    }
+    retained = 0;
+}
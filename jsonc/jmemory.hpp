@@ -0,0 +1,124 @@
+//
+// Licensed under the GNU LESSER GENERAL PUBLIC LICENSE version 3.0
+//  Created by Jed Young on 17/4/30.
+//  Copyright © 2017 chunquedong. All rights reserved.
+//
+
+
+#ifndef jmemory_hpp
+#define jmemory_hpp
+
+#include <stddef.h>
+#include <inttypes.h>
+#include <mutex>
+#include <vector>
+
+#if __cplusplus >= 201703L && defined(__has_include)
+#if __has_include(<memory_resource>)
+#include <memory_resource>
+#define JSONC_PMR 1
+#endif
+#endif
+
+namespace jsonc {
+
+    /**
+    * Where JsonAllocator gets its blocks, see JsonAllocator::set_source.
+    * Blocks are at least 16 byte aligned. Implementations must be thread safe
+    * when shared by allocators of several threads.
+    */
+    class MemorySource {
+    public:
+        virtual ~MemorySource() {}
+        /** NULL on failure */
+        virtual void* alloc_block(size_t size) = 0;
+        /** size is the one given to alloc_block */
+        virtual void free_block(void* block, size_t size) = 0;
+    };
+
+    enum class HugePages : uint8_t {
+        None,
+        /** madvise(MADV_HUGEPAGE), the kernel backs the blocks when it can */
+        Transparent,
+        /** reserved huge pages (MAP_HUGETLB, MEM_LARGE_PAGES), falls back to Transparent */
+        Explicit,
+    };
+
+    /**
+    * Blocks mapped directly from the OS, rounded up to whole pages.
+    * Use a large JsonAllocator block size with it, one mapping per block.
+    */
+    class PageSource : public MemorySource {
+    public:
+        static const int NumaAny = -1;
+        /** the node of the thread that first touches the page */
+        static const int NumaLocal = -2;
+
+        HugePages hugePages = HugePages::None;
+        /** NumaAny, NumaLocal or a node number to prefer */
+        int numaNode = NumaAny;
+
+        void* alloc_block(size_t size) override;
+        void free_block(void* block, size_t size) override;
+    private:
+        size_t mappedSize(size_t size);
+    };
+
+    /**
+    * Process-wide recycler. Freed blocks are kept in power-of-two size classes
+    * and handed out again, so allocators created per request do not reach
+    * malloc once the pool is warm.
+    */
+    class BlockPool : public MemorySource {
+        //4 KB to 2 GB
+        static const int ClassCount = 20;
+        std::mutex lock;
+        std::vector<void*> freeBlocks[ClassCount];
+        size_t retained;
+        MemorySource* upstream;
+    public:
+        /** bytes kept at most, larger frees go to upstream */
+        size_t maxRetained = 64 * 1024 * 1024;
+
+        /** upstream NULL: malloc */
+        BlockPool(MemorySource* upstream = NULL) : retained(0), upstream(upstream) {}
+        ~BlockPool();
+
+        /** the shared pool of the process */
+        static BlockPool& global();
+
+        void* alloc_block(size_t size) override;
+        void free_block(void* block, size_t size) override;
+        /** return every cached block to upstream */
+        void trim();
+    private:
+        BlockPool(const BlockPool&);
+        BlockPool& operator=(const BlockPool&);
+    };
+
+#ifdef JSONC_PMR
+    /**
+    * Blocks from a std::pmr::memory_resource.
+    */
+    class PmrSource : public MemorySource {
+        std::pmr::memory_resource* resource;
+    public:
+        PmrSource(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+            : resource(resource) {}
+
+        void* alloc_block(size_t size) override {
+            try {
+                return resource->allocate(size, 16);
+            }
+            catch (...) {
+                return NULL;
+            }
+        }
+        void free_block(void* block, size_t size) override {
+            resource->deallocate(block, size, 16);
+        }
+    };
+#endif
+}
+
+#endif /* jmemory_hpp */
@@ -0,0 +1,30 @@
+//
+// Licensed under the GNU LESSER GENERAL PUBLIC LICENSE version 3.0
+//  Created by Jed Young on 17/4/30.
+//  Copyright © 2017 chunquedong. All rights reserved.
+//
+
+
+#ifndef jnumber_hpp
+#define jnumber_hpp
+
+#include "jvalue.hpp"
+
+namespace jsonc {
+
+    /**
+    * Parse a JSON number at p without reading at or past end (NULL: the text is
+    * NUL terminated). Sets out to Integer, or to Float when the number has a
+    * fraction/exponent or does not fit in int64. Floats are correctly rounded.
+    * Returns the first byte after the number, or NULL on a syntax error.
+    */
+    const char* parse_number(const char* p, const char* end, Value* out);
+
+    /**
+    * Check the number at p without converting it. isFloat is set to the type
+    * parse_number would give. Returns the first byte after it, or NULL.
+    */
+    const char* skip_number(const char* p, const char* end, bool* isFloat);
+}
+
+#endif /* jnumber_hpp */
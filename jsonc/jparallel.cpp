@@ -0,0 +1,211 @@
+//
+// Licensed under the GNU LESSER GENERAL PUBLIC LICENSE version 3.0
+//  Created by Jed Young on 17/4/30.
+//  Copyright © 2017 chunquedong. All rights reserved.
+//
+
+
+#include "jparser.hpp"
+#include "jsplit.hpp"
+#include "jsimd.hpp"
+#include "jscan.hpp"
+#include "jintern.hpp"
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+using namespace jsonc;
+
+//smallest range handed to a thread
+#define JSONC_MIN_ARRAY_CHUNK (1024 * 1024)
+
+namespace {
+struct ArrayShard {
+    size_t begin;
+    size_t end;
+    JsonAllocator* allocator;
+    JsonNode* head;
+    JsonNode* tail;
+    size_t count;
+    char* stop;
+    char error[128];
+};
+}
+
+/**
+* Change of the bracket depth over [begin, end), starting in or out of a string.
+*/
+static long depthDelta(const char* src, size_t begin, size_t end, bool inString) {
+    long depth = 0;
+    const char* p = src + begin;
+    const char* e = src + end;
+    while (true) {
+        p = scan_brackets(p, e);
+        if (p == e) break;
+        if (*p == '"') {
+            if (!is_escaped(src, p - src)) inString = !inString;
+        }
+        else if (!inString) {
+            depth += (*p == '[' || *p == '{') ? 1 : -1;
+        }
+        ++p;
+    }
+    return depth;
+}
+
+/**
+* First comma at or after pos that separates elements of the root array.
+* Returns len if there is none.
+*/
+static size_t findSplit(const char* src, size_t len, size_t pos, bool inString, long depth) {
+    const char* p = src + pos;
+    const char* end = src + len;
+    if (inString && is_escaped(src, pos)) ++p;
+    while (p < end) {
+        if (inString) {
+            p = scan_str(p, end);
+            if (p == end) break;
+            if (*p == '\\') p += 2;
+            else {
+                if (*p == '"') inString = false;
+                ++p;
+            }
+            continue;
+        }
+        switch (*p) {
+        case '"': inString = true; break;
+        case '[':
+        case '{': ++depth; break;
+        case ']':
+        case '}':
+            if (--depth <= 0) return len;
+            break;
+        case ',':
+            if (depth == 1) return p - src;
+            break;
+        default:
+            break;
+        }
+        ++p;
+    }
+    return len;
+}
+
+static void parseShard(char* src, ArrayShard& shard, bool last, bool rawNumbers, size_t maxDepth) {
+    JsonParser parser(shard.allocator);
+    parser.rawNumbers = rawNumbers;
+    //elements are one level below the root array
+    parser.maxDepth = maxDepth ? maxDepth - 1 : 0;
+    char* p = src + shard.begin;
+    char* stop = src + shard.end;
+    shard.head = NULL;
+    shard.tail = NULL;
+    shard.count = 0;
+    shard.error[0] = 0;
+    while (true) {
+        JsonNode* val = (JsonNode*)parser.parse(p);
+        if (!val) {
+            snprintf(shard.error, 128, "%s", parser.get_error());
+            return;
+        }
+        if (shard.tail) shard.tail->_next = val;
+        else shard.head = val;
+        shard.tail = val;
+        ++shard.count;
+
+        p = parser.get_end();
+        while (isspace(*p)) ++p;
+        if (!last && p == stop) break;
+        if (*p == ',' && p != stop) {
+            ++p;
+            continue;
+        }
+        if (last && *p == ']') {
+            shard.stop = p + 1;
+            return;
+        }
+        if (*p == 0) snprintf(shard.error, 128, "Unexpected end of stream");
+        else snprintf(shard.error, 128, "Unexpected token '%c' at %s", *p, p);
+        return;
+    }
+}
+
+Value* JsonParser::parse_parallel(char* src, size_t len, int maxThreads) {
+    const char* first = skip_space(src, src + len);
+    int n = thread_count(len, maxThreads, JSONC_MIN_ARRAY_CHUNK);
+    if (n <= 1 || first == src + len || *first != '[') return parse(src);
+    size_t open = first - src;
+    first = skip_space(first + 1, src + len);
+    if (first < src + len && *first == ']') return parse(src);
+
+    this->src = src;
+    error[0] = 0;
+
+    //string state and bracket depth at the start of each equal chunk
+    std::vector<size_t> starts(n);
+    for (int i = 0; i < n; ++i) {
+        starts[i] = len / n * i;
+    }
+    starts[0] = open + 1;
+    std::vector<char> inString;
+    string_states(src, len, starts, inString);
+    std::vector<long> delta(n);
+    parallel_run(n, [&](int i) {
+        size_t end = i + 1 < n ? starts[i + 1] : len;
+        delta[i] = depthDelta(src, starts[i], end, inString[i] != 0);
+    });
+    std::vector<long> depth(n);
+    depth[0] = 1;
+    for (int i = 1; i < n; ++i) {
+        depth[i] = depth[i - 1] + delta[i - 1];
+    }
+
+    //element ranges end at the first top-level comma after each chunk start
+    std::vector<size_t> splits(n);
+    parallel_run(n, [&](int i) {
+        splits[i] = i + 1 < n ? findSplit(src, len, starts[i + 1], inString[i + 1] != 0, depth[i + 1]) : len;
+    });
+    std::vector<ArrayShard> work;
+    size_t begin = open + 1;
+    for (int i = 0; i < n; ++i) {
+        //the comma was taken by an earlier range, merge this chunk into the next
+        if (splits[i] < begin) continue;
+        ArrayShard shard;
+        shard.begin = begin;
+        shard.end = splits[i];
+        work.push_back(shard);
+        if (splits[i] >= len) break;
+        begin = splits[i] + 1;
+    }
+    n = (int)work.size();
+    for (int i = 0; i < n; ++i) {
+        work[i].allocator = new JsonAllocator();
+    }
+    parallel_run(n, [&](int i) {
+        parseShard(src, work[i], i + 1 == n, rawNumbers, maxDepth);
+    });
+
+    //join the element lists in order, the arenas move into ours
+    JsonNode* array = alloc(Type::Array);
+    array->value.child = NULL;
+    JsonNode* tail = NULL;
+    for (int i = 0; i < n; ++i) {
+        ArrayShard& shard = work[i];
+        if (shard.error[0] && !error[0]) {
+            snprintf(error, 128, "%s", shard.error);
+        }
+        if (!error[0] && shard.head) {
+            if (tail) tail->_next = shard.head;
+            else array->value.child = shard.head;
+            tail = shard.tail;
+            array->_len += (uint32_t)shard.count;
+        }
+        allocator->merge(*shard.allocator);
+        delete shard.allocator;
+    }
+    if (error[0]) return setRoot(NULL);
+    //the table is not thread safe, keys are interned after the join
+    if (keyTable) intern_keys(array, keyTable);
+    cur = work[n - 1].stop;
+    return setRoot(array);
+}
@@ -6,56 +6,29 @@
 
 
 #include "jparser.hpp"
+#include "jsimd.hpp"
+#include "jnumber.hpp"
+#include "jintern.hpp"
 #include <stdlib.h>
+#include <string.h>
 #include <stdexcept>
 
 using namespace jsonc;
 
-JsonNode* JsonParser::parseObj() {
-    JsonNode* obj = alloc(Type::Object);
-    obj->value.child = NULL;
-    ++cur;
-
-    skipWhitespace();
-    if (*cur == '}') {
-        ++cur;
-        return obj;
-    }
-    while (true)
-    {
-        if (*cur != '"') {
-            snprintf(error, 128, "object key must be string, got '%c' at %s", *cur, cur);
-            return NULL;
-        }
-        JsonNode key;
-        key._type = Type::String;
-        parseStr(&key);
-        skipWhitespace();
-        expect(':');
-        JsonNode*val = parseVal();
-        if (!key.value.str || !val) return NULL;
-        obj->insert_pair(key.value.str, val);
-
-        skipWhitespace();
-        if (*cur == ',') {
-            ++cur;
-            skipWhitespace();
-            continue;
-        }
-        else {
-            break;
-        }
-    }
-    expect('}');
-    obj->reverse();
-    return obj;
-}
-
 JsonNode* JsonParser::parseVal() {
-begin:
+    //iterative: containers are appended in order, nesting is bounded by maxDepth
+    FrameStack<BuildFrame> stack(allocator);
+    JsonNode* root = NULL;
+    JsonNode* val = NULL;
+    const char* key = NULL;
+    bool open = false;
+
+value:
     switch (*cur) {
     case '"':
-        return parseStr();
+        val = parseStr();
+        if (!val) return NULL;
+        goto attach;
     case '0':
     case '1':
     case '2':
@@ -67,18 +40,34 @@ begin:
     case '8':
     case '9':
     case '-':
-        return parseNum();
+        val = parseNum();
+        if (!val) return NULL;
+        goto attach;
     case '{':
-        return parseObj();
-    case '[':
-        return parseArray();
+    case '[': {
+        if (stack.size() >= maxDepth) {
+            snprintf(error, 128, "Too deep nesting at %s", cur);
+            return NULL;
+        }
+        val = alloc(*cur == '{' ? Type::Object : Type::Array);
+        val->value.child = NULL;
+        ++cur;
+        skipWhitespace();
+        if (*cur == (val->_type == Type::Object ? '}' : ']')) {
+            ++cur;
+        }
+        else {
+            open = true;
+        }
+        goto attach;
+    }
     case 't': {
         //"true"
         if (cur[1] == 'r' && cur[2] == 'u' && cur[3] == 'e') {
             cur += 4;
-            JsonNode*val = alloc(Type::Boolean);
+            val = alloc(Type::Boolean);
             val->value.b = true;
-            return val;
+            goto attach;
         }
         else {
             goto error;
@@ -88,9 +77,9 @@ begin:
         //"false"
         if (cur[1] == 'a' && cur[2] == 'l' && cur[3] == 's' && cur[4] == 'e') {
             cur += 5;
-            JsonNode*val = alloc(Type::Boolean);
+            val = alloc(Type::Boolean);
             val->value.b = false;
-            return val;
+            goto attach;
         }
         else {
             goto error;
@@ -100,8 +89,8 @@ begin:
         //"null"
         if (cur[1] == 'u' && cur[2] == 'l' && cur[3] == 'l') {
             cur += 4;
-            JsonNode*val = alloc(Type::Null);
-            return val;
+            val = alloc(Type::Null);
+            goto attach;
         }
         else {
             goto error;
@@ -112,11 +101,68 @@ begin:
     case '\r':
     case ' ': {
         ++cur;
-        goto begin;
+        goto value;
     }
     default:
-        break;
+        goto error;
+    }
+
+attach:
+    if (stack.empty()) {
+        root = val;
+    }
+    else {
+        BuildFrame* top = stack.back();
+        if (top->node->_type == Type::Object) val->name = key;
+        top->append(val);
+    }
+    if (open) {
+        open = false;
+        BuildFrame* frame = stack.push();
+        frame->node = val;
+        frame->tail = NULL;
+        if (val->_type == Type::Object) goto key;
+        goto value;
+    }
+
+next:
+    if (stack.empty()) {
+        return root;
+    }
+    skipWhitespace();
+    if (stack.back()->node->_type == Type::Object) {
+        if (*cur == ',') {
+            ++cur;
+            skipWhitespace();
+            goto key;
+        }
+        if (!expect('}')) return NULL;
+    }
+    else {
+        if (*cur == ',') {
+            ++cur;
+            goto value;
+        }
+        if (!expect(']')) return NULL;
+    }
+    stack.pop();
+    goto next;
+
+key:
+    if (*cur != '"') {
+        snprintf(error, 128, "object key must be string, got '%c' at %s", *cur, cur);
+        return NULL;
+    }
+    {
+        JsonNode k;
+        k._type = Type::String;
+        if (!parseStr(&k)) return NULL;
+        key = internKey(k.value.str);
     }
+    skipWhitespace();
+    if (!expect(':')) return NULL;
+    goto value;
+
 error:
     if (*cur == 0) snprintf(error, 128, "Unexpected end of stream");
     else {
@@ -125,36 +171,35 @@ error:
     return NULL;
 }
 
-JsonNode* JsonParser::parseNum() {
-    JsonNode*val = alloc(Type::Integer);
-
-    char *start = cur;
-    if (*cur == '-') ++cur;
-    while (true) {
-        char c = *cur;
-        if (c == '.' || c == 'E' || c == 'e') {
-            val->_type = Type::Float;
-            break;
-        }
-        else if ((c <= '9' && c >= '0')) {
-            ++cur;
-            continue;
-        }
-        else {
-            break;
-        }
+JsonNode* JsonParser::rawNum(const char* end, bool copy) {
+    bool isFloat;
+    const char* e = skip_number(cur, end, &isFloat);
+    if (!e) return NULL;
+    const char* str = cur;
+    if (copy) {
+        char* s = (char*)allocator->allocate_raw(e - cur);
+        memcpy(s, cur, e - cur);
+        str = s;
     }
+    JsonNode* val = alloc(Type::Integer);
+    val->set_raw_num(str, (uint32_t)(e - cur), isFloat);
+    cur = (char*)e;
+    return val;
+}
 
-    if (val->_type == Type::Float) {
-        char *end;
-        double v = strtod(start, &end);
-        val->value.d = v;
-        cur = end;
+JsonNode* JsonParser::parseNum() {
+    if (rawNumbers) {
+        JsonNode* val = rawNum(NULL, false);
+        if (!val) snprintf(error, 128, "Invalid number at %s", cur);
+        return val;
     }
-    else {
-        int64_t v = atoll(start);
-        val->value.i = v;
+    JsonNode*val = alloc(Type::Integer);
+    const char* end = parse_number(cur, NULL, val);
+    if (!end) {
+        snprintf(error, 128, "Invalid number at %s", cur);
+        return NULL;
     }
+    cur = (char*)end;
     return val;
 }
 
@@ -168,52 +213,137 @@ static inline int char2int(char c) {
     return (c & ~' ') - 'A' + 10;
 }
 
-void JsonParser::parseEscape(char* str)
-{
-    // check basics
-    switch (*cur) {
-    case 'b':   *str = '\b'; ++cur; break;
-    case 'f':   *str = '\f'; ++cur; break;
-    case 'n':   *str = '\n'; ++cur; break;
-    case 'r':   *str = '\r'; ++cur; break;
-    case 't':   *str = '\t'; ++cur; break;
-    case '"':   *str = '"'; ++cur; break;
-    case '\\':  *str = '\\'; ++cur; break;
-    case '/':   *str = '/'; ++cur; break;
-    case 'u':
-        int c = 0;
-        for (int i = 0; i < 4; ++i) {
-            if (isxdigit(*++cur)) {
-                c = c * 16 + char2int(*cur);
-            }
-            else {
-                snprintf(error, 128, "unknow hex char %d", *cur);
+static inline bool readHex4(const char* p, int& c) {
+    c = 0;
+    for (int i = 0; i < 4; ++i) {
+        if (!isxdigit(p[i])) return false;
+        c = c * 16 + char2int(p[i]);
+    }
+    return true;
+}
+
+static inline char* writeUtf8(char* str, int c) {
+    if (c < 0x80) {
+        *str++ = c;
+    }
+    else if (c < 0x800) {
+        *str++ = 0xC0 | (c >> 6);
+        *str++ = 0x80 | (c & 0x3F);
+    }
+    else if (c < 0x10000) {
+        *str++ = 0xE0 | (c >> 12);
+        *str++ = 0x80 | ((c >> 6) & 0x3F);
+        *str++ = 0x80 | (c & 0x3F);
+    }
+    else {
+        *str++ = 0xF0 | (c >> 18);
+        *str++ = 0x80 | ((c >> 12) & 0x3F);
+        *str++ = 0x80 | ((c >> 6) & 0x3F);
+        *str++ = 0x80 | (c & 0x3F);
+    }
+    return str;
+}
+
+size_t jsonc::unescape_str(const char* raw, size_t len, char* out) {
+    const char* p = raw;
+    const char* end = raw + len;
+    char* str = out;
+    while (p < end) {
+        const char* esc = (const char*)memchr(p, '\\', end - p);
+        if (!esc) esc = end;
+        memcpy(str, p, esc - p);
+        str += esc - p;
+        p = esc;
+        if (p == end) break;
+        if (++p == end) return (size_t)-1;
+        switch (*p++) {
+        case 'b':   *str++ = '\b'; break;
+        case 'f':   *str++ = '\f'; break;
+        case 'n':   *str++ = '\n'; break;
+        case 'r':   *str++ = '\r'; break;
+        case 't':   *str++ = '\t'; break;
+        case 'u': {
+            int c;
+            if (end - p < 4 || !readHex4(p, c)) return (size_t)-1;
+            p += 4;
+            //surrogate pair
+            if (c >= 0xD800 && c < 0xDC00 && end - p >= 6 && p[0] == '\\' && p[1] == 'u') {
+                int low;
+                if (readHex4(p + 2, low) && low >= 0xDC00 && low < 0xE000) {
+                    c = 0x10000 + ((c - 0xD800) << 10) + (low - 0xDC00);
+                    p += 6;
+                }
             }
+            str = writeUtf8(str, c);
+            break;
         }
-        if (c < 0x80) {
-            *str = c;
+        case '"':   *str++ = '"'; break;
+        case '\\':  *str++ = '\\'; break;
+        case '/':   *str++ = '/'; break;
+        default:
+            break;
         }
-        else if (c < 0x800) {
-            *str++ = 0xC0 | (c >> 6);
-            *str = 0x80 | (c & 0x3F);
+    }
+    return str - out;
+}
+
+char* JsonParser::parseEscape(char* str)
+{
+    // check basics
+    switch (*cur) {
+    case 'b':   *str++ = '\b'; ++cur; break;
+    case 'f':   *str++ = '\f'; ++cur; break;
+    case 'n':   *str++ = '\n'; ++cur; break;
+    case 'r':   *str++ = '\r'; ++cur; break;
+    case 't':   *str++ = '\t'; ++cur; break;
+    case '"':   *str++ = '"'; ++cur; break;
+    case '\\':  *str++ = '\\'; ++cur; break;
+    case '/':   *str++ = '/'; ++cur; break;
+    case 'u': {
+        int c;
+        if (!readHex4(cur + 1, c)) {
+            snprintf(error, 128, "unknow hex char at %s", cur);
+            return NULL;
         }
-        else {
-            *str++ = 0xE0 | (c >> 12);
-            *str++ = 0x80 | ((c >> 6) & 0x3F);
-            *str = 0x80 | (c & 0x3F);
+        cur += 5;
+        //surrogate pair
+        if (c >= 0xD800 && c < 0xDC00 && cur[0] == '\\' && cur[1] == 'u') {
+            int low;
+            if (readHex4(cur + 2, low) && low >= 0xDC00 && low < 0xE000) {
+                c = 0x10000 + ((c - 0xD800) << 10) + (low - 0xDC00);
+                cur += 6;
+            }
         }
+        str = writeUtf8(str, c);
+        break;
+    }
+    default:
         break;
     }
+    return str;
 }
 
 JsonNode* JsonParser::parseStr(JsonNode* val) {
     ++cur;
+    char* str = unescape();
+    if (!str) return NULL;
     if (!val) {
         val = alloc(Type::String);
     }
-    val->value.str = cur;
+    val->value.str = str;
+    return val;
+}
+
+char* JsonParser::unescape() {
+    char* start = cur;
     char *str = cur;
     while(true) {
+        //skip the plain run, shift it down if an escape moved the write cursor
+        char* stop = (char*)scan_str(cur);
+        if (str != cur) memmove(str, cur, stop - cur);
+        str += stop - cur;
+        cur = stop;
+
         switch (*cur)
         {
         case 0:
@@ -221,45 +351,322 @@ JsonNode* JsonParser::parseStr(JsonNode* val) {
             return NULL;
         case '\\':
             ++cur;
-            parseEscape(str);
+            str = parseEscape(str);
+            if (!str) return NULL;
             break;
         case '"':
             *str = 0;
             ++cur;
-            return val;
-        
+            return start;
         default:
-            ++cur;
-            ++str;
+            //control character
+            *str++ = *cur++;
             break;
         }
     }
     return NULL;
 }
 
-JsonNode* JsonParser::parseArray() {
-    ++cur;
-    JsonNode* array = alloc(Type::Array);
-    array->value.child = NULL;
+/////////////////////////////////////////////////////////////////
+// Two-stage parse
+/////////////////////////////////////////////////////////////////
 
-    skipWhitespace();
-    if (*cur == ']') {
-        ++cur;
-        return array;
+Value* JsonParser::parse_indexed(char* src, size_t len) {
+    return setRoot(parseIndexed(src, len, true));
+}
+
+Value* JsonParser::parse(const char* data, size_t len) {
+    return setRoot(parseIndexed(data, len, false));
+}
+
+char* JsonParser::copyStr(const char* raw, size_t len) {
+    //unescape a private copy, the closing quote stops the scan and the
+    //NUL after it bounds the error message of a bad escape
+    char* buf = (char*)allocator->allocate_raw(len + 2);
+    memcpy(buf, raw, len);
+    buf[len] = '"';
+    buf[len + 1] = 0;
+    char* saved = cur;
+    cur = buf;
+    char* str = unescape();
+    cur = saved;
+    return str;
+}
+
+const char* JsonParser::internKey(const char* key) {
+    return keyTable ? keyTable->intern(key) : key;
+}
+
+const char* JsonParser::scanConstStr(const char* end, bool* escaped) {
+    const char* p = cur + 1;
+    *escaped = false;
+    while (true) {
+        p = scan_str(p, end);
+        if (p == end) {
+            snprintf(error, 128, "Unexpected end of stream in paserStr");
+            return NULL;
+        }
+        if (*p == '"') return p;
+        if (*p == '\\') {
+            *escaped = true;
+            p += 2;
+            if (p > end) p = end;
+        }
+        else {
+            ++p;
+        }
     }
-    while (true)
-    {
-        JsonNode* val = parseVal();
-        if (!val) return NULL;
-        array->insert(val);
-        skipWhitespace();
-        if (*cur != ',') break;
+}
+
+const char* JsonParser::parseConstKey(const char* end) {
+    if (!keyTable) return parseConstStr(end);
+    const char* raw = cur + 1;
+    bool escaped;
+    const char* p = scanConstStr(end, &escaped);
+    if (!p) return NULL;
+    cur = (char*)p + 1;
+    if (escaped) {
+        char* str = copyStr(raw, p - raw);
+        return str ? keyTable->intern(str) : NULL;
+    }
+    //plain keys go to the table without a copy in the allocator
+    return keyTable->intern(raw, p - raw);
+}
+
+char* JsonParser::parseConstStr(const char* end) {
+    const char* raw = cur + 1;
+    bool escaped;
+    const char* p = scanConstStr(end, &escaped);
+    if (!p) return NULL;
+    cur = (char*)p + 1;
+    if (escaped) return copyStr(raw, p - raw);
+
+    char* str = (char*)allocator->allocate_raw(p - raw + 1);
+    memcpy(str, raw, p - raw);
+    str[p - raw] = 0;
+    return str;
+}
+
+JsonNode* JsonParser::parseRefStr(const char* end) {
+    const char* raw = cur + 1;
+    bool escaped;
+    const char* p = scanConstStr(end, &escaped);
+    if (!p) return NULL;
+    cur = (char*)p + 1;
+    JsonNode* val = alloc(Type::String);
+    if (escaped) {
+        val->value.str = copyStr(raw, p - raw);
+        return val->value.str ? val : NULL;
+    }
+    //the closing quote stays in data, the length marks the end
+    val->value.str = (char*)raw;
+    val->_flag = 6;
+    val->_len = (uint32_t)(p - raw);
+    return val;
+}
+
+JsonNode* JsonParser::parseScalar(const char* end, bool copy) {
+    size_t n = end - cur;
+    JsonNode* val;
+    switch (*cur) {
+    case 't':
+        if (n < 4 || memcmp(cur, "true", 4) != 0) return NULL;
+        cur += 4;
+        val = alloc(Type::Boolean);
+        val->value.b = true;
+        return val;
+    case 'f':
+        if (n < 5 || memcmp(cur, "false", 5) != 0) return NULL;
+        cur += 5;
+        val = alloc(Type::Boolean);
+        val->value.b = false;
+        return val;
+    case 'n':
+        if (n < 4 || memcmp(cur, "null", 4) != 0) return NULL;
+        cur += 4;
+        return alloc(Type::Null);
+    default: {
+        if (rawNumbers) return rawNum(end, copy);
+        val = alloc(Type::Integer);
+        const char* e = parse_number(cur, end, val);
+        if (!e) return NULL;
+        cur = (char*)e;
+        return val;
+    }
+    }
+}
+
+JsonNode* JsonParser::parseIndexed(const char* data, size_t len, bool inPlace) {
+    //in-place mode unescapes strings inside src, otherwise data is only read
+    char* src = (char*)data;
+    const char* end = src + len;
+    this->src = src;
+    cur = src;
+    error[0] = 0;
+
+    if (!index) index = new StructuralIndex();
+    switch (index->build(src, len)) {
+    case IndexStatus::Ok: break;
+    case IndexStatus::InString:
+        snprintf(error, 128, "Unexpected end of stream in paserStr");
+        return NULL;
+    case IndexStatus::TooLarge:
+        snprintf(error, 128, "Input too large for the structural index: %llu bytes", (unsigned long long)len);
+        return NULL;
+    case IndexStatus::NoMemory:
+        snprintf(error, 128, "Out of memory for the structural index: %llu bytes", (unsigned long long)len);
+        return NULL;
+    }
+    const uint32_t* tok = index->data();
+    const uint32_t* tokEnd = tok + index->size();
+
+    FrameStack<BuildFrame> stack(allocator);
+    JsonNode* root = NULL;
+    JsonNode* val = NULL;
+    const char* key = NULL;
+    bool open = false;
+
+value:
+    if (tok == tokEnd) {
+        cur = src + len;
+        snprintf(error, 128, "Unexpected end of stream");
+        return NULL;
+    }
+    cur = src + *tok++;
+    switch (*cur) {
+    case '{':
+    case '[':
+        if (stack.size() >= maxDepth) {
+            snprintf(error, 128, "Too deep nesting at %.*s", (int)(end - cur), cur);
+            return NULL;
+        }
+        val = alloc(*cur == '{' ? Type::Object : Type::Array);
+        val->value.child = NULL;
+        ++cur;
+        if (tok != tokEnd && src[*tok] == (val->_type == Type::Object ? '}' : ']')) {
+            cur = src + *tok++ + 1;
+        }
         else {
-            ++cur;
+            open = true;
+        }
+        goto attach;
+    case '"':
+        if (inPlace) {
+            val = parseStr();
+            if (!val) return NULL;
+        }
+        else if (stringRefs) {
+            val = parseRefStr(end);
+            if (!val) return NULL;
         }
+        else {
+            char* str = parseConstStr(end);
+            if (!str) return NULL;
+            val = alloc(Type::String);
+            val->value.str = str;
+        }
+        goto attach;
+    case 't':
+    case 'f':
+    case 'n':
+    case '-':
+    case '0':
+    case '1':
+    case '2':
+    case '3':
+    case '4':
+    case '5':
+    case '6':
+    case '7':
+    case '8':
+    case '9':
+        val = parseScalar(end, !inPlace);
+        if (!val) goto error;
+        if (cur != end && !isScalarEnd(*cur)) goto error;
+        goto attach;
+    default:
+        goto error;
+    }
+
+attach:
+    if (stack.empty()) {
+        root = val;
+    }
+    else {
+        BuildFrame* top = stack.back();
+        if (top->node->_type == Type::Object) val->name = key;
+        top->append(val);
+    }
+    if (open) {
+        open = false;
+        BuildFrame* frame = stack.push();
+        frame->node = val;
+        frame->tail = NULL;
+        if (val->_type == Type::Object) goto key;
+        goto value;
+    }
+
+next:
+    if (stack.empty()) {
+        return root;
+    }
+    if (tok == tokEnd) {
+        cur = src + len;
+        snprintf(error, 128, "Unexpected end of stream");
+        return NULL;
+    }
+    cur = src + *tok++;
+    if (*cur == ',') {
+        if (stack.back()->node->_type == Type::Object) goto key;
+        goto value;
+    }
+    else if ((*cur == '}' && stack.back()->node->_type == Type::Object) ||
+             (*cur == ']' && stack.back()->node->_type == Type::Array)) {
+        ++cur;
+        stack.pop();
+        goto next;
     }
+    goto error;
 
-    expect(']');
-    array->reverse();
-    return array;
+key:
+    if (tok == tokEnd) {
+        cur = src + len;
+        snprintf(error, 128, "Unexpected end of stream");
+        return NULL;
+    }
+    if (src[*tok] != '"') {
+        cur = src + *tok;
+        snprintf(error, 128, "object key must be string, got '%c' at %.*s", *cur, (int)(end - cur), cur);
+        return NULL;
+    }
+    cur = src + *tok++;
+    if (inPlace) {
+        JsonNode k;
+        k._type = Type::String;
+        if (!parseStr(&k)) return NULL;
+        key = internKey(k.value.str);
+    }
+    else {
+        key = parseConstKey(end);
+        if (!key) return NULL;
+    }
+    if (tok == tokEnd) {
+        cur = src + len;
+        snprintf(error, 128, "Unexpected end of stream");
+        return NULL;
+    }
+    if (src[*tok] != ':') {
+        cur = src + *tok;
+        snprintf(error, 128, "':' Expected, got '%c' at %.*s", *cur, (int)(end - cur), cur);
+        return NULL;
+    }
+    ++tok;
+    goto value;
+
+error:
+    if (cur == end || *cur == 0) snprintf(error, 128, "Unexpected end of stream");
+    else {
+        snprintf(error, 128, "Unexpected token '%c' at %.*s", *cur, (int)(end - cur), cur);
+    }
+    return NULL;
 }
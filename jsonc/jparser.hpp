@@ -12,60 +12,183 @@
 
 namespace jsonc {
 
+    struct StreamState;
+    class StructuralIndex;
+    class KeyTable;
+
+    /**
+    * Decode the escapes of a raw string body (no quotes) into out, which
+    * needs room for len bytes. Returns the decoded length, or (size_t)-1
+    * on a malformed escape.
+    */
+    size_t unescape_str(const char* raw, size_t len, char* out);
+
     class JsonParser {
         char* src;
         char* cur;
         char error[128];
         JsonAllocator* allocator;
+        StreamState* stream;
+        //parse_indexed and parse(data, len) reuse its buffer
+        StructuralIndex* index;
+        //result of the last parse, for get_summary
+        Value* root;
+        //parse_tape builds here, kept for the next parse
+        std::vector<Value> tape;
     public:
-        JsonParser() : src(NULL), cur(NULL), allocator(NULL) {
+        /**
+        * Keep numbers as raw text (see Value::set_raw_num). They are converted
+        * on access, and to_json writes the original digits.
+        */
+        bool rawNumbers = false;
+
+        /**
+        * parse(data, len) references escape-free strings in data by their
+        * length instead of copying them, only escaped strings are copied.
+        * data must outlive the tree. The text of such a string is not NUL
+        * terminated: read it with as_str() and str_len(), or as_str(allocator).
+        * Keys are copied either way.
+        */
+        bool stringRefs = false;
+
+        /** Containers nested deeper than this are an error */
+        size_t maxDepth = 1024;
+
+        /**
+        * Objects with at least this many members get a hash index after the
+        * parse (see index_keys), 0: none. Not for parse_tape.
+        */
+        size_t indexKeys = 0;
+
+        /**
+        * Intern object keys here (see jintern.hpp), NULL: keys point into
+        * the document. Can be shared by every parse, it must outlive the trees.
+        */
+        KeyTable* keyTable = NULL;
+
+        JsonParser() : src(NULL), cur(NULL), allocator(NULL), stream(NULL), index(NULL), root(NULL) {
             error[0] = 0;
         }
-        JsonParser(JsonAllocator* allocator) : src(NULL), cur(NULL) {
+        JsonParser(JsonAllocator* allocator) : src(NULL), cur(NULL), stream(NULL), index(NULL), root(NULL) {
             error[0] = 0;
             this->allocator = allocator;
         }
+        ~JsonParser();
         void init(JsonAllocator* allocator) { this->allocator = allocator; }
         
         Value* parse(char* src) {
             this->src = src;
             cur = src;
-            return parseVal();
+            error[0] = 0;
+            return setRoot(parseVal());
         }
 
+        /**
+        * Parse len bytes of read-only input. Never writes to data and never
+        * reads past data + len, so no terminator is needed. Strings are
+        * copied into the allocator.
+        */
+        Value* parse(const char* data, size_t len);
+
+        /**
+        * Two-stage parse: a vectorized pass indexes the structural characters,
+        * then the tree is built by jumping from index to index.
+        * Produces the same tree as parse(). src must be NUL terminated at len.
+        */
+        Value* parse_indexed(char* src, size_t len);
+
+        /**
+        * Parse a document whose root is a large array on several threads
+        * (maxThreads 0: one per core). Elements are split at top-level commas
+        * and parsed in place into per-thread allocators, which are merged into
+        * this parser's allocator. Other documents fall back to parse().
+        * src must be NUL terminated at len.
+        */
+        Value* parse_parallel(char* src, size_t len, int maxThreads = 0);
+
+        /**
+        * Parse in place into a tape: one 16 byte Value per value in document
+        * order, containers know where their children end and object members
+        * are a key entry followed by the value. Strings stay in src.
+        * The result is read-only, with the same get/begin/end/as_* API as a
+        * tree, and is copied into the allocator in one piece.
+        * src must be NUL terminated.
+        */
+        Value* parse_tape(char* src);
+
+        /**
+        * Push-mode parse. Feed the document in chunks as they arrive, then
+        * call finish() to get the root. Strings are copied into the allocator,
+        * so a chunk can be reused as soon as feed returns.
+        * feed returns false once an error is found.
+        */
+        bool feed(const char* chunk, size_t len);
+        Value* finish();
+
         char* get_end() { return cur; }
         bool has_error() { return error[0] == 0; }
         const char* get_error() { return error; }
+
+        /** Node counts, string bytes and depth of the last parsed document */
+        ParseSummary get_summary() { return summarize(root); }
+        /** Memory used by the allocator */
+        AllocatorStats get_stats() { return allocator->get_stats(); }
         
     private:
-        inline JsonNode* alloc(Type type) {
-            JsonNode* v = (JsonNode*)allocator->allocate(sizeof(JsonNode));
-            v->_type = type;
+        Value* setRoot(Value* v) {
+            root = v;
+            if (v && indexKeys) index_keys(v, allocator, indexKeys);
             return v;
         }
-        JsonNode* parseObj();
+        inline JsonNode* alloc(Type type) {
+            return allocator->allocNode(type);
+        }
         JsonNode* parseVal();
         JsonNode* parseNum();
         JsonNode* parseStr(JsonNode* val = NULL);
-        JsonNode* parseArray();
-        void parseEscape(char* str);
+        char* parseEscape(char* str);
+        char* unescape();
+        char* copyStr(const char* raw, size_t len);
+        const char* scanConstStr(const char* end, bool* escaped);
+        char* parseConstStr(const char* end);
+        JsonNode* parseRefStr(const char* end);
+        const char* parseConstKey(const char* end);
+        const char* internKey(const char* key);
+        JsonNode* parseScalar(const char* end, bool copy);
+        JsonNode* rawNum(const char* end, bool copy);
+        JsonNode* parseIndexed(const char* data, size_t len, bool inPlace);
+        bool parseTape();
+        Value* tapePush(Type type) {
+            tape.push_back(Value(type));
+            return &tape.back();
+        }
+        bool streamString(const char* raw, size_t len);
+        bool streamScalar();
+        void streamAttach(JsonNode* val);
+        bool isScalarEnd(char c) {
+            return c == 0 || c == ',' || c == ']' || c == '}' || c == ':' || isspace(c);
+        }
     private:
     
         inline void consume() {
             ++cur;
         }
         
-        inline void expect(char tt) {
+        inline bool expect(char tt) {
             if (*cur != tt) {
                 snprintf(error, 128, "'%c' Expected, got '%c' at %s", tt, *cur, cur);
-                return;
+                return false;
             }
             ++cur;
+            return true;
         }
         
         void skipWhitespace() {
             while (isspace(*cur)) ++cur;
         }
+
+        JsonParser(const JsonParser&);
+        JsonParser& operator=(const JsonParser&);
     };
     
 }
@@ -0,0 +1,395 @@
+//
+// Licensed under the GNU LESSER GENERAL PUBLIC LICENSE version 3.0
+//  Created by Jed Young on 17/4/30.
+//  Copyright © 2017 chunquedong. All rights reserved.
+//
+
+
+#include "jpatch.hpp"
+#include "jintern.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+using namespace jsonc;
+
+namespace {
+struct MergeFrame {
+    JsonNode* target;
+    JsonIterator it;
+    JsonIterator end;
+};
+
+struct EqualFrame {
+    Value* a;
+    Value* b;
+    JsonIterator ia;
+    JsonIterator ib;
+    JsonIterator end;
+};
+}
+
+//the node keeps its place, name and _next, the value of val moves in
+static inline void setValue(JsonNode* node, JsonNode* val) {
+    *(Value*)node = *(Value*)val;
+}
+
+static inline bool isReadOnly(Value* v) {
+    return v->_flag == 1 || v->_flag == 3;
+}
+
+//array index token, "-" is the end. -1 if malformed
+static long arrayIndex(const std::string& key, size_t size) {
+    if (key == "-") return (long)size;
+    if (key.empty() || key.size() > 9 || key.find_first_not_of("0123456789") != std::string::npos ||
+        (key[0] == '0' && key.size() > 1)) {
+        return -1;
+    }
+    return atol(key.c_str());
+}
+
+static inline bool isNumber(Value* v) {
+    return v->type() == Type::Integer || v->type() == Type::Float;
+}
+
+static bool scalarEquals(Value* a, Value* b) {
+    if (isNumber(a) && isNumber(b)) {
+        if (a->type() == Type::Integer && b->type() == Type::Integer) return a->as_int() == b->as_int();
+        return a->as_float() == b->as_float();
+    }
+    if (a->type() != b->type()) return false;
+    switch (a->type()) {
+    case Type::String: {
+        size_t len = a->str_len();
+        return len == b->str_len() && memcmp(a->as_str(), b->as_str(), len) == 0;
+    }
+    case Type::Boolean:
+        return a->as_bool() == b->as_bool();
+    default:
+        return true;
+    }
+}
+
+bool jsonc::json_equals(Value* a, Value* b) {
+    FrameStack<EqualFrame> stack;
+
+value:
+    if (a->type() == Type::Array || a->type() == Type::Object) {
+        if (a->type() != b->type() || a->size() != b->size()) return false;
+        EqualFrame* frame = stack.push();
+        frame->a = a;
+        frame->b = b;
+        frame->ia = a->begin();
+        frame->ib = b->begin();
+        frame->end = b->end();
+    }
+    else if (!scalarEquals(a, b)) {
+        return false;
+    }
+
+    while (!stack.empty()) {
+        EqualFrame* top = stack.back();
+        if (!(top->ib != top->end)) {
+            stack.pop();
+            continue;
+        }
+        if (top->b->type() == Type::Object) {
+            //members in any order
+            a = top->a->get(top->ib.get_name());
+            if (!a) return false;
+        }
+        else {
+            a = *top->ia;
+            ++top->ia;
+        }
+        b = *top->ib;
+        ++top->ib;
+        goto value;
+    }
+    return true;
+}
+
+const char* JsonPatcher::copyKey(const char* key) {
+    return keyTable ? keyTable->intern(key) : allocator->strdup(key);
+}
+
+void JsonPatcher::replaceRoot(JsonNode* root, JsonNode* val) {
+    setValue(root, val);
+    keys.clear();
+    nodes.assign(1, root);
+}
+
+bool JsonPatcher::merge(JsonNode* root, Value* patch) {
+    error[0] = 0;
+    if (isReadOnly(root)) {
+        snprintf(error, 128, "read-only document");
+        return false;
+    }
+    if (patch->type() != Type::Object) {
+        setValue(root, patch->clone_into(allocator));
+        return true;
+    }
+
+    FrameStack<MergeFrame> stack;
+    JsonNode* target = root;
+    Value* v = patch;
+
+object:
+    if (target->type() != Type::Object) {
+        //the old value goes, the members are merged into an empty object
+        setValue(target, allocator->allocNode(Type::Object));
+    }
+    {
+        MergeFrame* frame = stack.push();
+        frame->target = target;
+        frame->it = v->begin();
+        frame->end = v->end();
+    }
+
+    while (!stack.empty()) {
+        MergeFrame* top = stack.back();
+        if (!(top->it != top->end)) {
+            stack.pop();
+            continue;
+        }
+        Value* val = *top->it;
+        const char* name = top->it.get_name();
+        ++top->it;
+
+        if (val->type() == Type::Null) {
+            top->target->remove(name);
+            continue;
+        }
+        JsonNode* cur = (JsonNode*)top->target->get(name, allocator);
+        if (val->type() == Type::Object) {
+            if (!cur) {
+                cur = allocator->allocNode(Type::Object);
+                top->target->insert_pair(copyKey(name), cur);
+            }
+            target = cur;
+            v = val;
+            goto object;
+        }
+        JsonNode* copy = val->clone_into(allocator);
+        if (cur) setValue(cur, copy);
+        else top->target->insert_pair(copyKey(name), copy);
+    }
+    return true;
+}
+
+bool JsonPatcher::apply(JsonNode* root, Value* patch) {
+    error[0] = 0;
+    if (isReadOnly(root)) {
+        snprintf(error, 128, "read-only document");
+        return false;
+    }
+    if (patch->type() != Type::Array) {
+        snprintf(error, 128, "JSON Patch must be an array");
+        return false;
+    }
+    //the tree may have changed since the last call
+    keys.clear();
+    nodes.clear();
+    for (auto p = patch->begin(); p != patch->end(); ++p) {
+        if (!applyOp(root, *p)) return false;
+    }
+    return true;
+}
+
+bool JsonPatcher::applyOp(JsonNode* root, Value* op) {
+    if (op->type() != Type::Object) {
+        snprintf(error, 128, "operation must be an object");
+        return false;
+    }
+    Value* pathVal = op->get("path");
+    if (!pathVal || pathVal->type() != Type::String) {
+        snprintf(error, 128, "operation without path");
+        return false;
+    }
+    //the patch may reference unterminated strings, see JsonParser::stringRefs
+    Value* nameVal = op->get("op");
+    std::string nameStr = nameVal ? std::string(nameVal->as_str(), nameVal->str_len()) : "";
+    std::string pathStr(pathVal->as_str(), pathVal->str_len());
+    const char* name = nameStr.c_str();
+    const char* path = pathStr.c_str();
+
+    bool needValue = strcmp(name, "add") == 0 || strcmp(name, "replace") == 0 || strcmp(name, "test") == 0;
+    bool needFrom = strcmp(name, "move") == 0 || strcmp(name, "copy") == 0;
+    Value* val = op->get("value");
+    Value* fromVal = op->get("from");
+    if (needValue && !val) {
+        snprintf(error, 128, "%s without value: %s", name, path);
+        return false;
+    }
+    if (needFrom && (!fromVal || fromVal->type() != Type::String)) {
+        snprintf(error, 128, "%s without from: %s", name, path);
+        return false;
+    }
+
+    if (strcmp(name, "add") == 0) {
+        return add(root, path, val->clone_into(allocator));
+    }
+    if (strcmp(name, "remove") == 0) {
+        return detach(root, path) != NULL;
+    }
+    if (strcmp(name, "replace") == 0) {
+        JsonNode* target = find(root, path);
+        if (!target) return false;
+        if (target == root) replaceRoot(root, val->clone_into(allocator));
+        else setValue(target, val->clone_into(allocator));
+        return true;
+    }
+    if (strcmp(name, "test") == 0) {
+        JsonNode* target = find(root, path);
+        if (!target) return false;
+        if (!json_equals(target, val)) {
+            snprintf(error, 128, "test failed: %s", path);
+            return false;
+        }
+        return true;
+    }
+    if (needFrom) {
+        std::string fromStr(fromVal->as_str(), fromVal->str_len());
+        const char* from = fromStr.c_str();
+        if (name[0] == 'c') {
+            JsonNode* src = find(root, from);
+            if (!src) return false;
+            return add(root, path, src->clone_into(allocator));
+        }
+        size_t n = strlen(from);
+        if (strcmp(from, path) == 0) return find(root, from) != NULL;
+        if (strncmp(from, path, n) == 0 && path[n] == '/') {
+            snprintf(error, 128, "can not move into itself: %s", path);
+            return false;
+        }
+        //the node is relinked, not copied
+        JsonNode* node = detach(root, from);
+        if (!node) return false;
+        return add(root, path, node);
+    }
+    snprintf(error, 128, "unknown op '%s'", name);
+    return false;
+}
+
+bool JsonPatcher::split(const char* pointer, std::vector<std::string>& out) {
+    out.clear();
+    if (*pointer && *pointer != '/') {
+        snprintf(error, 128, "JSON Pointer must start with '/': %s", pointer);
+        return false;
+    }
+    const char* p = pointer;
+    while (*p) {
+        ++p;
+        out.push_back(std::string());
+        std::string& name = out.back();
+        for (; *p && *p != '/'; ++p) {
+            if (*p != '~') {
+                name += *p;
+            }
+            else if (p[1] == '0' || p[1] == '1') {
+                name += p[1] == '0' ? '~' : '/';
+                ++p;
+            }
+            else {
+                snprintf(error, 128, "bad escape in JSON Pointer: %s", pointer);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+JsonNode* JsonPatcher::child(JsonNode* parent, const std::string& key, const char* pointer) {
+    Value* v = NULL;
+    if (parent->type() == Type::Object) {
+        v = parent->get(key.c_str(), allocator);
+    }
+    else if (parent->type() == Type::Array) {
+        long i = arrayIndex(key, parent->size());
+        if (i >= 0) v = parent->at(i);
+    }
+    if (!v) snprintf(error, 128, "path not found: %s", pointer);
+    return (JsonNode*)v;
+}
+
+JsonNode* JsonPatcher::resolve(JsonNode* root, const char* pointer, std::string& last) {
+    if (!split(pointer, tokens)) return NULL;
+    assert(!tokens.empty());
+    size_t depth = tokens.size() - 1;
+    if (nodes.empty() || nodes[0] != root) {
+        keys.clear();
+        nodes.assign(1, root);
+    }
+
+    //ops only change the children of the parent they resolved,
+    //so the cached path above it is still valid
+    size_t n = 0;
+    while (n < keys.size() && n < depth && keys[n] == tokens[n]) ++n;
+    keys.resize(n);
+    nodes.resize(n + 1);
+    for (; n < depth; ++n) {
+        JsonNode* next = child(nodes[n], tokens[n], pointer);
+        if (!next) return NULL;
+        keys.push_back(tokens[n]);
+        nodes.push_back(next);
+    }
+    last.swap(tokens[depth]);
+    return nodes[depth];
+}
+
+JsonNode* JsonPatcher::find(JsonNode* root, const char* pointer) {
+    if (!*pointer) return root;
+    std::string last;
+    JsonNode* parent = resolve(root, pointer, last);
+    if (!parent) return NULL;
+    return child(parent, last, pointer);
+}
+
+JsonNode* JsonPatcher::detach(JsonNode* root, const char* pointer) {
+    if (!*pointer) {
+        snprintf(error, 128, "can not remove the root");
+        return NULL;
+    }
+    std::string last;
+    JsonNode* parent = resolve(root, pointer, last);
+    if (!parent) return NULL;
+    JsonNode* node = NULL;
+    if (parent->type() == Type::Object) {
+        node = parent->remove(last.c_str());
+    }
+    else if (parent->type() == Type::Array) {
+        long i = arrayIndex(last, parent->size());
+        if (i >= 0) node = parent->remove_at(i);
+    }
+    if (!node) snprintf(error, 128, "path not found: %s", pointer);
+    return node;
+}
+
+bool JsonPatcher::add(JsonNode* root, const char* pointer, JsonNode* val) {
+    if (!*pointer) {
+        replaceRoot(root, val);
+        return true;
+    }
+    std::string last;
+    JsonNode* parent = resolve(root, pointer, last);
+    if (!parent) return false;
+    if (parent->type() == Type::Object) {
+        JsonNode* cur = (JsonNode*)parent->get(last.c_str(), allocator);
+        if (cur) setValue(cur, val);
+        else parent->insert_pair(copyKey(last.c_str()), val);
+        return true;
+    }
+    if (parent->type() == Type::Array) {
+        long i = arrayIndex(last, parent->size());
+        if (i < 0 || (size_t)i > parent->size()) {
+            snprintf(error, 128, "bad array index: %s", pointer);
+            return false;
+        }
+        val->name = NULL;
+        parent->insert_at(i, val, allocator);
+        return true;
+    }
+    snprintf(error, 128, "path not found: %s", pointer);
+    return false;
+}
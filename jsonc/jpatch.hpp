@@ -0,0 +1,78 @@
+//
+// Licensed under the GNU LESSER GENERAL PUBLIC LICENSE version 3.0
+//  Created by Jed Young on 17/4/30.
+//  Copyright © 2017 chunquedong. All rights reserved.
+//
+
+
+#ifndef jpatch_hpp
+#define jpatch_hpp
+
+#include "jvalue.hpp"
+#include <vector>
+#include <string>
+
+namespace jsonc {
+
+    class KeyTable;
+
+    /*
+    * Apply JSON Merge Patch (RFC 7386) and JSON Patch (RFC 6902) documents
+    * to a mutable tree in place. Subtrees the patch does not touch stay
+    * where they are, values taken from the patch are copied into the
+    * allocator of the target, so the patch may be freed afterwards.
+    * Consecutive ops under the same parent resolve the shared part of
+    * their paths once. New members go first, as with JsonNode::set.
+    *
+    *   JsonPatcher patcher(&allocator);
+    *   if (!patcher.apply(root, ops)) puts(patcher.get_error());
+    *
+    * The root keeps its address, a patch of the whole document replaces
+    * its value. On error the ops before the failing one stay applied,
+    * patch a clone_into() copy when that matters. v3 and tape trees are
+    * read-only and can not be patched.
+    */
+    class JsonPatcher {
+        JsonAllocator* allocator;
+        //parent path of the last op: keys[i] leads from nodes[i] to nodes[i + 1]
+        std::vector<std::string> keys;
+        std::vector<JsonNode*> nodes;
+        std::vector<std::string> tokens;
+        char error[128];
+    public:
+        /** new keys are interned here when set, see JsonParser::keyTable */
+        KeyTable* keyTable = NULL;
+
+        /** allocator of the target trees */
+        JsonPatcher(JsonAllocator* allocator) : allocator(allocator) {
+            error[0] = 0;
+        }
+
+        /** RFC 7386, null members of patch delete */
+        bool merge(JsonNode* root, Value* patch);
+
+        /** RFC 6902, patch is an Array of operation objects */
+        bool apply(JsonNode* root, Value* patch);
+
+        const char* get_error() { return error; }
+
+    private:
+        bool applyOp(JsonNode* root, Value* op);
+        bool split(const char* pointer, std::vector<std::string>& out);
+        JsonNode* resolve(JsonNode* root, const char* pointer, std::string& last);
+        JsonNode* child(JsonNode* parent, const std::string& key, const char* pointer);
+        JsonNode* find(JsonNode* root, const char* pointer);
+        JsonNode* detach(JsonNode* root, const char* pointer);
+        bool add(JsonNode* root, const char* pointer, JsonNode* val);
+        const char* copyKey(const char* key);
+        void replaceRoot(JsonNode* root, JsonNode* val);
+
+        JsonPatcher(const JsonPatcher&);
+        JsonPatcher& operator=(const JsonPatcher&);
+    };
+
+    /** deep equality as RFC 6902 "test" defines it, numbers compare by value */
+    bool json_equals(Value* a, Value* b);
+}
+
+#endif /* jpatch_hpp */
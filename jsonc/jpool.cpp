@@ -0,0 +1,176 @@
+//
+// Licensed under the GNU LESSER GENERAL PUBLIC LICENSE version 3.0
+//  Created by Jed Young on 17/4/30.
+//  Copyright © 2017 chunquedong. All rights reserved.
+//
+
+
+#include "jpool.hpp"
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+namespace jsonc {
+
+struct CacheEntry;
+
+/**
+* The caches of one pool in every thread. The pool drains them when it is
+* destroyed, threads unregister theirs at exit.
+*/
+struct PoolRegistry {
+    std::mutex lock;
+    std::vector<CacheEntry*> entries;
+    //set under lock once the pool has drained every entry
+    std::atomic<bool> closed;
+
+    PoolRegistry() : closed(false) {}
+};
+
+struct CacheEntry {
+    std::shared_ptr<PoolRegistry> registry;
+    std::vector<JsonAllocator*> allocators;
+};
+
+}
+
+using namespace jsonc;
+
+namespace {
+
+//set when the cache of this thread is gone, pools in static objects outlive it
+thread_local bool threadCacheDone = false;
+
+static void deleteAll(std::vector<JsonAllocator*>& allocators) {
+    for (JsonAllocator* a : allocators) delete a;
+    allocators.clear();
+}
+
+/**
+* Per thread lists of free allocators, one entry per pool. Entries of
+* destroyed pools are already empty and are dropped on the next lookup.
+*/
+struct ThreadCache {
+    std::vector<CacheEntry*> entries;
+
+    ~ThreadCache() {
+        for (CacheEntry* e : entries) {
+            {
+                std::lock_guard<std::mutex> guard(e->registry->lock);
+                if (!e->registry->closed) {
+                    unregister(e);
+                    deleteAll(e->allocators);
+                }
+            }
+            delete e;
+        }
+        threadCacheDone = true;
+    }
+
+    static void unregister(CacheEntry* e) {
+        std::vector<CacheEntry*>& list = e->registry->entries;
+        for (size_t i = 0; i < list.size(); ++i) {
+            if (list[i] == e) {
+                list.erase(list.begin() + i);
+                return;
+            }
+        }
+    }
+
+    std::vector<JsonAllocator*>* find(const std::shared_ptr<PoolRegistry>& registry, bool create) {
+        for (size_t i = 0; i < entries.size(); ) {
+            CacheEntry* e = entries[i];
+            if (e->registry == registry) return &e->allocators;
+            if (e->registry->closed) {
+                //the pool is done with it once closed is set, the lock waits for that
+                { std::lock_guard<std::mutex> guard(e->registry->lock); }
+                delete e;
+                entries.erase(entries.begin() + i);
+                continue;
+            }
+            ++i;
+        }
+        if (!create) return NULL;
+        CacheEntry* e = new CacheEntry();
+        e->registry = registry;
+        {
+            std::lock_guard<std::mutex> guard(registry->lock);
+            registry->entries.push_back(e);
+        }
+        entries.push_back(e);
+        return &e->allocators;
+    }
+
+    void remove(const std::shared_ptr<PoolRegistry>& registry) {
+        for (size_t i = 0; i < entries.size(); ++i) {
+            CacheEntry* e = entries[i];
+            if (e->registry != registry) continue;
+            {
+                std::lock_guard<std::mutex> guard(registry->lock);
+                unregister(e);
+            }
+            deleteAll(e->allocators);
+            delete e;
+            entries.erase(entries.begin() + i);
+            return;
+        }
+    }
+};
+
+thread_local ThreadCache threadCache;
+
+}
+
+void AllocatorLease::release() {
+    if (allocator) pool->release(allocator);
+    allocator = NULL;
+}
+
+JsonAllocatorPool::JsonAllocatorPool(size_t blockSize) : registry(new PoolRegistry()), blockSize(blockSize) {
+}
+
+JsonAllocatorPool::~JsonAllocatorPool() {
+    //free the allocators cached by every thread while source is still there
+    std::lock_guard<std::mutex> guard(registry->lock);
+    for (CacheEntry* e : registry->entries) {
+        deleteAll(e->allocators);
+    }
+    registry->entries.clear();
+    registry->closed = true;
+}
+
+JsonAllocator* JsonAllocatorPool::acquire() {
+    std::vector<JsonAllocator*>* list = threadCacheDone ? NULL : threadCache.find(registry, false);
+    if (list && !list->empty()) {
+        JsonAllocator* a = list->back();
+        list->pop_back();
+        return a;
+    }
+    JsonAllocator* a = new JsonAllocator(blockSize);
+    a->set_source(source);
+    //take the first block now, the request does not pay for it
+    a->allocate_raw(1);
+    a->reset();
+    return a;
+}
+
+void JsonAllocatorPool::release(JsonAllocator* a) {
+    if (!a) return;
+    std::vector<JsonAllocator*>* list = threadCacheDone ? NULL : threadCache.find(registry, true);
+    if (!list || list->size() >= maxCached) {
+        delete a;
+        return;
+    }
+    a->reset();
+    a->trim(maxRetained);
+    list->push_back(a);
+}
+
+void JsonAllocatorPool::trim() {
+    if (!threadCacheDone) threadCache.remove(registry);
+}
+
+size_t JsonAllocatorPool::cached() {
+    std::vector<JsonAllocator*>* list = threadCacheDone ? NULL : threadCache.find(registry, false);
+    return list ? list->size() : 0;
+}
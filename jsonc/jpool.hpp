@@ -0,0 +1,84 @@
+//
+// Licensed under the GNU LESSER GENERAL PUBLIC LICENSE version 3.0
+//  Created by Jed Young on 17/4/30.
+//  Copyright © 2017 chunquedong. All rights reserved.
+//
+
+
+#ifndef jpool_hpp
+#define jpool_hpp
+
+#include "jvalue.hpp"
+#include <memory>
+
+namespace jsonc {
+
+    class JsonAllocatorPool;
+    struct PoolRegistry;
+
+    /**
+    * An allocator borrowed from a JsonAllocatorPool, given back on destruction.
+    */
+    class AllocatorLease {
+        JsonAllocatorPool* pool;
+        JsonAllocator* allocator;
+    public:
+        AllocatorLease(JsonAllocatorPool* pool, JsonAllocator* allocator) : pool(pool), allocator(allocator) {}
+        AllocatorLease(AllocatorLease&& other) : pool(other.pool), allocator(other.allocator) {
+            other.allocator = NULL;
+        }
+        ~AllocatorLease() { release(); }
+
+        JsonAllocator* get() { return allocator; }
+        JsonAllocator* operator->() { return allocator; }
+        operator JsonAllocator*() { return allocator; }
+
+        /** give the allocator back early, the values in it become invalid */
+        void release();
+    private:
+        AllocatorLease(const AllocatorLease&);
+        AllocatorLease& operator=(const AllocatorLease&);
+    };
+
+    /*
+    * Reset allocators cached per thread, for servers that need one allocator
+    * per request. acquire() and release() only touch the calling thread's
+    * cache, so there is no lock and, once warm, no malloc.
+    * The destructor frees the allocators cached by every thread, so no
+    * thread may use the pool or its leases by then, and source must
+    * outlive the pool.
+    *
+    *   AllocatorLease arena = pool.lease();
+    *   JsonParser parser(arena);
+    */
+    class JsonAllocatorPool {
+        std::shared_ptr<PoolRegistry> registry;
+        size_t blockSize;
+    public:
+        /** allocators kept per thread, more are deleted on release */
+        size_t maxCached = 4;
+        /** bytes an allocator keeps when it is given back, the rest is freed */
+        size_t maxRetained = 1024 * 1024;
+        /** blocks come from here, NULL: malloc. Must outlive the pool */
+        MemorySource* source = NULL;
+
+        /** blockSize: first block of every allocator, allocated up front */
+        JsonAllocatorPool(size_t blockSize = 64 * 1024);
+        ~JsonAllocatorPool();
+
+        JsonAllocator* acquire();
+        /** a may come from another thread, it is cached by the calling one */
+        void release(JsonAllocator* a);
+        AllocatorLease lease() { return AllocatorLease(this, acquire()); }
+
+        /** delete the allocators cached by the calling thread */
+        void trim();
+        /** allocators cached by the calling thread */
+        size_t cached();
+    private:
+        JsonAllocatorPool(const JsonAllocatorPool&);
+        JsonAllocatorPool& operator=(const JsonAllocatorPool&);
+    };
+}
+
+#endif /* jpool_hpp */
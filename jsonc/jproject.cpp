@@ -0,0 +1,266 @@
+//
+// Licensed under the GNU LESSER GENERAL PUBLIC LICENSE version 3.0
+//  Created by Jed Young on 17/4/30.
+//  Copyright © 2017 chunquedong. All rights reserved.
+//
+
+
+#include "jproject.hpp"
+#include "jscan.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace jsonc {
+
+struct ProjectNode {
+    std::string name;
+    //array index, -1 if the name is not a number
+    long index;
+    //keep the whole value
+    bool leaf;
+    ProjectNode* wildcard;
+    std::vector<ProjectNode*> children;
+
+    ProjectNode() : index(-1), leaf(false), wildcard(NULL) {}
+    ~ProjectNode() {
+        for (size_t i = 0; i < children.size(); ++i) {
+            delete children[i];
+        }
+        delete wildcard;
+    }
+};
+
+}
+
+using namespace jsonc;
+
+JsonProjection::JsonProjection() : depth(0), allocator(NULL), src(NULL), end(NULL) {
+    root = new ProjectNode();
+    error[0] = 0;
+}
+
+JsonProjection::~JsonProjection() {
+    delete root;
+}
+
+bool JsonProjection::add(const char* pointer) {
+    if (*pointer && *pointer != '/') {
+        snprintf(error, 128, "JSON Pointer must start with '/': %s", pointer);
+        return false;
+    }
+    ProjectNode* node = root;
+    size_t n = 0;
+    const char* p = pointer;
+    while (*p) {
+        ++p;
+        std::string name;
+        for (; *p && *p != '/'; ++p) {
+            if (*p != '~') {
+                name += *p;
+            }
+            else if (p[1] == '0' || p[1] == '1') {
+                name += p[1] == '0' ? '~' : '/';
+                ++p;
+            }
+            else {
+                snprintf(error, 128, "bad escape in JSON Pointer: %s", pointer);
+                return false;
+            }
+        }
+
+        ProjectNode* child = NULL;
+        if (name == "*") {
+            if (!node->wildcard) node->wildcard = new ProjectNode();
+            child = node->wildcard;
+        }
+        else {
+            for (size_t i = 0; i < node->children.size(); ++i) {
+                if (node->children[i]->name == name) {
+                    child = node->children[i];
+                    break;
+                }
+            }
+            if (!child) {
+                child = new ProjectNode();
+                child->name = name;
+                if (!name.empty() && name.size() < 10 && name.find_first_not_of("0123456789") == std::string::npos &&
+                    (name[0] != '0' || name.size() == 1)) {
+                    child->index = atol(name.c_str());
+                }
+                node->children.push_back(child);
+            }
+        }
+        node = child;
+        ++n;
+    }
+    node->leaf = true;
+    if (n > depth) depth = n;
+    return true;
+}
+
+void JsonProjection::fail(const char* msg, const char* p) {
+    if (error[0]) return;
+    if (p >= end) snprintf(error, 128, "Unexpected end of stream");
+    else snprintf(error, 128, "%s '%c' at offset %llu", msg, *p, (unsigned long long)(p - src));
+}
+
+Value* JsonProjection::parse(const char* data, size_t len, JsonAllocator* allocator) {
+    this->allocator = allocator;
+    src = data;
+    end = data + len;
+    error[0] = 0;
+    //recursion only follows the paths, so this bounds the nesting
+    levels.resize(depth + 2);
+    levels[0].clear();
+    levels[0].push_back(root);
+
+    const char* p = skip_space(data, end);
+    if (p >= end) {
+        fail("", p);
+        return NULL;
+    }
+    char first = *p;
+    JsonNode* val = project(p, 0);
+    if (error[0]) return NULL;
+    if (!val) {
+        //nothing selected, an empty container of the same kind
+        val = allocator->allocNode(first == '[' ? Type::Array : Type::Object);
+        val->value.child = NULL;
+    }
+    return val;
+}
+
+JsonNode* JsonProjection::parseAll(const char*& p) {
+    DomHandler dom(allocator);
+    if (!sax.parse(p, end - p, dom)) {
+        fail("Unexpected token", p + sax.get_offset());
+        return NULL;
+    }
+    p += sax.get_offset();
+    return (JsonNode*)dom.get_root();
+}
+
+bool JsonProjection::match(const ProjectNode* node, const char* key, size_t len, long index) {
+    if (index >= 0) return node->index == index;
+    return node->name.size() == len && memcmp(node->name.data(), key, len) == 0;
+}
+
+JsonNode* JsonProjection::project(const char*& p, size_t level) {
+    const std::vector<const ProjectNode*>& nodes = levels[level];
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        if (nodes[i]->leaf) return parseAll(p);
+    }
+
+    bool isObject = *p == '{';
+    if (!isObject && *p != '[') {
+        //a scalar where the path expects a container
+        const char* next = skip_value(p, end);
+        if (!next) {
+            fail("Malformed value", p);
+            return NULL;
+        }
+        p = next;
+        return NULL;
+    }
+
+    std::vector<const ProjectNode*>& sub = levels[level + 1];
+    JsonNode* container = NULL;
+    JsonNode* tail = NULL;
+    char close = isObject ? '}' : ']';
+    p = skip_space(p + 1, end);
+    if (p < end && *p == close) {
+        ++p;
+        return NULL;
+    }
+    for (long index = 0; ; ++index) {
+        const char* key = NULL;
+        size_t keyLen = 0;
+        if (isObject) {
+            if (p >= end || *p != '"') {
+                fail("object key must be string, got", p);
+                return NULL;
+            }
+            const char* q = skip_string(p, end);
+            if (!q) {
+                fail("", end);
+                return NULL;
+            }
+            key = p + 1;
+            keyLen = q - 1 - key;
+            if (memchr(key, '\\', keyLen)) {
+                scratch.resize(keyLen);
+                keyLen = unescape_str(key, keyLen, &scratch[0]);
+                if (keyLen == (size_t)-1) {
+                    fail("unknow hex char at", p);
+                    return NULL;
+                }
+                key = scratch.data();
+            }
+            p = skip_space(q, end);
+            if (p >= end || *p != ':') {
+                fail("':' Expected, got", p);
+                return NULL;
+            }
+            p = skip_space(p + 1, end);
+        }
+
+        sub.clear();
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            const ProjectNode* node = nodes[i];
+            if (node->wildcard) sub.push_back(node->wildcard);
+            for (size_t k = 0; k < node->children.size(); ++k) {
+                if (match(node->children[k], key, keyLen, isObject ? -1 : index)) {
+                    sub.push_back(node->children[k]);
+                }
+            }
+        }
+
+        if (p >= end) {
+            fail("", p);
+            return NULL;
+        }
+        if (sub.empty()) {
+            const char* next = skip_value(p, end);
+            if (!next) {
+                fail("Malformed value", p);
+                return NULL;
+            }
+            p = next;
+        }
+        else {
+            char* name = NULL;
+            if (isObject) {
+                //the key may live in scratch, copy it before going deeper
+                name = (char*)allocator->allocate_raw(keyLen + 1);
+                memcpy(name, key, keyLen);
+                name[keyLen] = 0;
+            }
+            JsonNode* val = project(p, level + 1);
+            if (error[0]) return NULL;
+            if (val) {
+                if (!container) {
+                    container = allocator->allocNode(isObject ? Type::Object : Type::Array);
+                    container->value.child = NULL;
+                }
+                val->name = name;
+                if (tail) tail->_next = val;
+                else container->value.child = val;
+                tail = val;
+                ++container->_len;
+            }
+        }
+
+        p = skip_space(p, end);
+        if (p < end && *p == ',') {
+            p = skip_space(p + 1, end);
+            continue;
+        }
+        if (p < end && *p == close) {
+            ++p;
+            return container;
+        }
+        fail("Unexpected token", p);
+        return NULL;
+    }
+}
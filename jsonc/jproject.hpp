@@ -0,0 +1,69 @@
+//
+// Licensed under the GNU LESSER GENERAL PUBLIC LICENSE version 3.0
+//  Created by Jed Young on 17/4/30.
+//  Copyright © 2017 chunquedong. All rights reserved.
+//
+
+
+#ifndef jproject_hpp
+#define jproject_hpp
+
+#include "jsax.hpp"
+#include <vector>
+#include <string>
+
+namespace jsonc {
+
+    struct ProjectNode;
+
+    /*
+    * A compiled set of JSON Pointer paths. parse() builds nodes only for the
+    * values on those paths and skips everything else without allocating.
+    * '*' in a path matches every member or element.
+    *
+    *   JsonProjection proj;
+    *   proj.add("/user/id");
+    *   proj.add("/entities/hashtags/0/text");
+    *   Value* v = proj.parse(data, len, &allocator);
+    */
+    class JsonProjection {
+        ProjectNode* root;
+        size_t depth;
+        //matching path nodes per nesting level
+        std::vector<std::vector<const ProjectNode*> > levels;
+        std::string scratch;
+        SaxParser<DomHandler> sax;
+        JsonAllocator* allocator;
+        const char* src;
+        const char* end;
+        char error[128];
+    public:
+        JsonProjection();
+        ~JsonProjection();
+
+        /**
+        * Add a JSON Pointer ("" selects the whole document).
+        * Returns false if the pointer is malformed.
+        */
+        bool add(const char* pointer);
+
+        /**
+        * Parse read-only input, keeping the projected values only. Kept array
+        * elements are packed in order. Returns NULL on a syntax error.
+        */
+        Value* parse(const char* data, size_t len, JsonAllocator* allocator);
+
+        const char* get_error() { return error; }
+
+    private:
+        JsonNode* project(const char*& p, size_t level);
+        JsonNode* parseAll(const char*& p);
+        bool match(const ProjectNode* node, const char* key, size_t len, long index);
+        void fail(const char* msg, const char* p);
+
+        JsonProjection(const JsonProjection&);
+        JsonProjection& operator=(const JsonProjection&);
+    };
+}
+
+#endif /* jproject_hpp */
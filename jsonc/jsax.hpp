@@ -0,0 +1,270 @@
+//
+// Licensed under the GNU LESSER GENERAL PUBLIC LICENSE version 3.0
+//  Created by Jed Young on 17/4/30.
+//  Copyright © 2017 chunquedong. All rights reserved.
+//
+
+
+#ifndef jsax_hpp
+#define jsax_hpp
+
+#include "jparser.hpp"
+#include "jscan.hpp"
+#include "jnumber.hpp"
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+namespace jsonc {
+
+    /*
+    * Event driven parser, no tree is built. Handler is called directly so the
+    * calls inline. Every callback returns false to stop the parse:
+    *
+    *   bool on_null();
+    *   bool on_bool(bool b);
+    *   bool on_int(int64_t i);
+    *   bool on_float(double d);
+    *   bool on_string(const char* str, size_t len);
+    *   bool on_key(const char* str, size_t len);
+    *   bool on_start_object();
+    *   bool on_end_object();
+    *   bool on_start_array();
+    *   bool on_end_array();
+    *
+    * Strings are unescaped but not NUL terminated, and only valid during the
+    * callback. The input is never modified.
+    */
+    template<typename Handler>
+    class SaxParser {
+        const char* src;
+        const char* cur;
+        const char* end;
+        bool stopped;
+        char error[128];
+        //escaped strings are decoded here
+        std::vector<char> scratch;
+        //true for object
+        std::vector<bool> stack;
+    public:
+        /** nesting deeper than this is an error */
+        size_t maxDepth = 1024;
+
+        SaxParser() : src(NULL), cur(NULL), end(NULL), stopped(false) {
+            error[0] = 0;
+        }
+
+        /**
+        * Returns true if a whole value was read. Returns false on a syntax error
+        * or when the handler stopped the parse, see is_stopped().
+        */
+        bool parse(const char* data, size_t len, Handler& handler);
+
+        bool is_stopped() { return stopped; }
+        const char* get_error() { return error; }
+        /** Offset of the first unread byte */
+        size_t get_offset() { return cur - src; }
+
+    private:
+        bool readStr(const char*& str, size_t& len);
+        bool fail(const char* msg) {
+            if (cur >= end) snprintf(error, 128, "Unexpected end of stream");
+            else snprintf(error, 128, "%s '%c' at offset %llu", msg, *cur, (unsigned long long)(cur - src));
+            return false;
+        }
+    };
+
+    template<typename Handler>
+    bool SaxParser<Handler>::readStr(const char*& str, size_t& len) {
+        const char* raw = cur + 1;
+        const char* q = skip_string(cur, end);
+        if (!q) {
+            cur = end;
+            snprintf(error, 128, "Unexpected end of stream in paserStr");
+            return false;
+        }
+        cur = q;
+        len = q - 1 - raw;
+        if (!memchr(raw, '\\', len)) {
+            str = raw;
+            return true;
+        }
+        if (scratch.size() < len) scratch.resize(len);
+        len = unescape_str(raw, len, scratch.data());
+        if (len == (size_t)-1) {
+            snprintf(error, 128, "unknow hex char at offset %llu", (unsigned long long)(raw - src));
+            return false;
+        }
+        str = scratch.data();
+        return true;
+    }
+
+#define JSONC_SAX_CALL(call) if (!(call)) { stopped = true; return false; }
+
+    template<typename Handler>
+    bool SaxParser<Handler>::parse(const char* data, size_t len, Handler& handler) {
+        src = data;
+        cur = data;
+        end = data + len;
+        stopped = false;
+        error[0] = 0;
+        stack.clear();
+        const char* str;
+        size_t n;
+
+    value:
+        cur = skip_space(cur, end);
+        if (cur >= end) return fail("");
+        switch (*cur) {
+        case '{':
+            if (stack.size() >= maxDepth) return fail("Too deep nesting");
+            JSONC_SAX_CALL(handler.on_start_object());
+            cur = skip_space(cur + 1, end);
+            if (cur < end && *cur == '}') {
+                ++cur;
+                JSONC_SAX_CALL(handler.on_end_object());
+                goto next;
+            }
+            stack.push_back(true);
+            goto key;
+        case '[':
+            if (stack.size() >= maxDepth) return fail("Too deep nesting");
+            JSONC_SAX_CALL(handler.on_start_array());
+            cur = skip_space(cur + 1, end);
+            if (cur < end && *cur == ']') {
+                ++cur;
+                JSONC_SAX_CALL(handler.on_end_array());
+                goto next;
+            }
+            stack.push_back(false);
+            goto value;
+        case '"':
+            if (!readStr(str, n)) return false;
+            JSONC_SAX_CALL(handler.on_string(str, n));
+            goto next;
+        case 't':
+            if (end - cur < 4 || memcmp(cur, "true", 4) != 0) return fail("Unexpected token");
+            cur += 4;
+            JSONC_SAX_CALL(handler.on_bool(true));
+            goto next;
+        case 'f':
+            if (end - cur < 5 || memcmp(cur, "false", 5) != 0) return fail("Unexpected token");
+            cur += 5;
+            JSONC_SAX_CALL(handler.on_bool(false));
+            goto next;
+        case 'n':
+            if (end - cur < 4 || memcmp(cur, "null", 4) != 0) return fail("Unexpected token");
+            cur += 4;
+            JSONC_SAX_CALL(handler.on_null());
+            goto next;
+        default: {
+            Value num;
+            const char* e = parse_number(cur, end, &num);
+            if (!e) return fail("Unexpected token");
+            cur = e;
+            if (num.type() == Type::Integer) {
+                JSONC_SAX_CALL(handler.on_int(num.value.i));
+            }
+            else {
+                JSONC_SAX_CALL(handler.on_float(num.value.d));
+            }
+            goto next;
+        }
+        }
+
+    next:
+        if (stack.empty()) return true;
+        cur = skip_space(cur, end);
+        if (cur >= end) return fail("");
+        if (*cur == ',') {
+            ++cur;
+            if (stack.back()) goto key;
+            goto value;
+        }
+        if (*cur == '}' && stack.back()) {
+            ++cur;
+            stack.pop_back();
+            JSONC_SAX_CALL(handler.on_end_object());
+            goto next;
+        }
+        if (*cur == ']' && !stack.back()) {
+            ++cur;
+            stack.pop_back();
+            JSONC_SAX_CALL(handler.on_end_array());
+            goto next;
+        }
+        return fail("Unexpected token");
+
+    key:
+        cur = skip_space(cur, end);
+        if (cur >= end || *cur != '"') return fail("object key must be string, got");
+        if (!readStr(str, n)) return false;
+        JSONC_SAX_CALL(handler.on_key(str, n));
+        cur = skip_space(cur, end);
+        if (cur >= end || *cur != ':') return fail("':' Expected, got");
+        ++cur;
+        goto value;
+    }
+
+#undef JSONC_SAX_CALL
+
+    /*
+    * Handler that builds the same tree as JsonParser.
+    */
+    class DomHandler {
+        JsonAllocator* allocator;
+        std::vector<BuildFrame> stack;
+        JsonNode* root;
+        const char* key;
+    public:
+        DomHandler(JsonAllocator* allocator) : allocator(allocator), root(NULL), key(NULL) {}
+
+        Value* get_root() { return root; }
+
+        bool on_null() { return attach(allocator->allocNode(Type::Null)); }
+        bool on_bool(bool b) { return attach(allocator->alloc_bool(b)); }
+        bool on_int(int64_t i) { return attach(allocator->alloc_int(i)); }
+        bool on_float(double d) { return attach(allocator->alloc_float(d)); }
+        bool on_string(const char* str, size_t len) {
+            JsonNode* val = allocator->allocNode(Type::String);
+            val->value.str = copy(str, len);
+            return attach(val);
+        }
+        bool on_key(const char* str, size_t len) {
+            key = copy(str, len);
+            return true;
+        }
+        bool on_start_object() { return open(Type::Object); }
+        bool on_end_object() { stack.pop_back(); return true; }
+        bool on_start_array() { return open(Type::Array); }
+        bool on_end_array() { stack.pop_back(); return true; }
+
+    private:
+        char* copy(const char* str, size_t len) {
+            char* s = (char*)allocator->allocate_raw(len + 1);
+            memcpy(s, str, len);
+            s[len] = 0;
+            return s;
+        }
+        bool open(Type type) {
+            JsonNode* val = allocator->allocNode(type);
+            val->value.child = NULL;
+            attach(val);
+            BuildFrame frame = { val, NULL };
+            stack.push_back(frame);
+            return true;
+        }
+        bool attach(JsonNode* val) {
+            if (stack.empty()) {
+                root = val;
+                return true;
+            }
+            BuildFrame& top = stack.back();
+            if (top.node->_type == Type::Object) val->name = key;
+            top.append(val);
+            return true;
+        }
+    };
+}
+
+#endif /* jsax_hpp */
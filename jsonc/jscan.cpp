@@ -0,0 +1,65 @@
+//
+// Licensed under the GNU LESSER GENERAL PUBLIC LICENSE version 3.0
+//  Created by Jed Young on 17/4/30.
+//  Copyright © 2017 chunquedong. All rights reserved.
+//
+
+
+#include "jscan.hpp"
+#include "jsimd.hpp"
+
+using namespace jsonc;
+
+const char* jsonc::skip_string(const char* p, const char* end) {
+    ++p;
+    while (true) {
+        p = scan_str(p, end);
+        if (p >= end) return NULL;
+        if (*p == '"') return p + 1;
+        if (*p == '\\') ++p;
+        ++p;
+    }
+}
+
+const char* jsonc::skip_value(const char* p, const char* end) {
+    if (p >= end) return NULL;
+    switch (*p) {
+    case '"':
+        return skip_string(p, end);
+    case '{':
+    case '[': {
+        int depth = 0;
+        while (true) {
+            p = scan_brackets(p, end);
+            if (p >= end) return NULL;
+            switch (*p) {
+            case '"':
+                p = skip_string(p, end);
+                if (!p) return NULL;
+                continue;
+            case '{':
+            case '[':
+                ++depth;
+                break;
+            default:
+                if (--depth == 0) return p + 1;
+                break;
+            }
+            ++p;
+        }
+    }
+    case ',':
+    case ':':
+    case '}':
+    case ']':
+        return NULL;
+    default:
+        //number or literal
+        while (p < end) {
+            char c = *p;
+            if (c == ',' || c == '}' || c == ']' || c == ' ' || c == '\t' || c == '\n' || c == '\r') break;
+            ++p;
+        }
+        return p;
+    }
+}
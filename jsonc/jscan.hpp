@@ -0,0 +1,33 @@
+//
+// Licensed under the GNU LESSER GENERAL PUBLIC LICENSE version 3.0
+//  Created by Jed Young on 17/4/30.
+//  Copyright © 2017 chunquedong. All rights reserved.
+//
+
+
+#ifndef jscan_hpp
+#define jscan_hpp
+
+#include <stddef.h>
+
+namespace jsonc {
+
+    inline const char* skip_space(const char* p, const char* end) {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) ++p;
+        return p;
+    }
+
+    /**
+    * p at the opening quote. Returns the byte after the closing quote,
+    * NULL if the string is not terminated before end.
+    */
+    const char* skip_string(const char* p, const char* end);
+
+    /**
+    * Jump over the value at p without allocating. Containers are skipped by
+    * bracket matching. Returns the byte after the value, NULL if malformed.
+    */
+    const char* skip_value(const char* p, const char* end);
+}
+
+#endif /* jscan_hpp */
@@ -0,0 +1,763 @@
+//
+// Licensed under the GNU LESSER GENERAL PUBLIC LICENSE version 3.0
+//  Created by Jed Young on 17/4/30.
+//  Copyright © 2017 chunquedong. All rights reserved.
+//
+
+
+#include "jsimd.hpp"
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef JSONC_X86
+#include <immintrin.h>
+#endif
+
+#if defined(JSONC_X86) && !defined(_MSC_VER)
+#define JSONC_TARGET_AVX2 __attribute__((target("avx2")))
+#define JSONC_TARGET_SSE2 __attribute__((target("sse2")))
+#else
+#define JSONC_TARGET_AVX2
+#define JSONC_TARGET_SSE2
+#endif
+
+using namespace jsonc;
+
+/////////////////////////////////////////////////////////////////
+// CPU detect
+/////////////////////////////////////////////////////////////////
+
+static SimdLevel detectSimd() {
+#if defined(JSONC_X86) && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    int maxId = info[0];
+    SimdLevel level = SimdLevel::SSE2;
+    if (maxId >= 7) {
+        __cpuid(info, 1);
+        bool osxsave = (info[2] & (1 << 27)) != 0;
+        bool avx = (info[2] & (1 << 28)) != 0;
+        if (osxsave && avx && (_xgetbv(0) & 6) == 6) {
+            __cpuidex(info, 7, 0);
+            if (info[1] & (1 << 5)) level = SimdLevel::AVX2;
+        }
+    }
+    return level;
+#elif defined(JSONC_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return SimdLevel::AVX2;
+    if (__builtin_cpu_supports("sse2")) return SimdLevel::SSE2;
+    return SimdLevel::Scalar;
+#else
+    return SimdLevel::Scalar;
+#endif
+}
+
+SimdLevel jsonc::simd_level() {
+    static SimdLevel level = detectSimd();
+    return level;
+}
+
+/////////////////////////////////////////////////////////////////
+// String scan
+/////////////////////////////////////////////////////////////////
+
+static inline bool isStrSpecial(char ch) {
+    unsigned char c = (unsigned char)ch;
+    return c == '"' || c == '\\' || c < 0x20;
+}
+
+static const char* scanStrScalar(const char* p) {
+    while (!isStrSpecial(*p)) ++p;
+    return p;
+}
+
+static const char* scanStrBoundedScalar(const char* p, const char* end) {
+    while (p < end && !isStrSpecial(*p)) ++p;
+    return p;
+}
+
+#ifdef JSONC_X86
+JSONC_TARGET_SSE2
+static inline unsigned strSpecialSSE2(__m128i v) {
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i ctrl = _mm_set1_epi8(0x1F);
+    //unsigned v <= 0x1F
+    __m128i special = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)),
+        _mm_cmpeq_epi8(_mm_max_epu8(v, ctrl), ctrl));
+    return (unsigned)_mm_movemask_epi8(special);
+}
+
+JSONC_TARGET_SSE2 JSONC_NO_SANITIZE
+static const char* scanStrSSE2(const char* p) {
+    const char* block = (const char*)((uintptr_t)p & ~(uintptr_t)15);
+    unsigned skip = (unsigned)(p - block);
+    while (true) {
+        unsigned mask = strSpecialSSE2(_mm_load_si128((const __m128i*)block)) >> skip << skip;
+        if (mask) return block + ctz64(mask);
+        block += 16;
+        skip = 0;
+    }
+}
+
+JSONC_TARGET_SSE2
+static const char* scanStrBoundedSSE2(const char* p, const char* end) {
+    for (; end - p >= 16; p += 16) {
+        unsigned mask = strSpecialSSE2(_mm_loadu_si128((const __m128i*)p));
+        if (mask) return p + ctz64(mask);
+    }
+    return scanStrBoundedScalar(p, end);
+}
+
+JSONC_TARGET_AVX2
+static inline uint64_t strSpecialAVX2(__m256i v) {
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i backslash = _mm256_set1_epi8('\\');
+    const __m256i ctrl = _mm256_set1_epi8(0x1F);
+    __m256i special = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, quote), _mm256_cmpeq_epi8(v, backslash)),
+        _mm256_cmpeq_epi8(_mm256_max_epu8(v, ctrl), ctrl));
+    return (uint32_t)_mm256_movemask_epi8(special);
+}
+
+JSONC_TARGET_AVX2 JSONC_NO_SANITIZE
+static const char* scanStrAVX2(const char* p) {
+    const char* block = (const char*)((uintptr_t)p & ~(uintptr_t)31);
+    unsigned skip = (unsigned)(p - block);
+    while (true) {
+        uint64_t mask = strSpecialAVX2(_mm256_load_si256((const __m256i*)block)) >> skip << skip;
+        if (mask) return block + ctz64(mask);
+        block += 32;
+        skip = 0;
+    }
+}
+
+JSONC_TARGET_AVX2
+static const char* scanStrBoundedAVX2(const char* p, const char* end) {
+    for (; end - p >= 32; p += 32) {
+        uint64_t mask = strSpecialAVX2(_mm256_loadu_si256((const __m256i*)p));
+        if (mask) return p + ctz64(mask);
+    }
+    return scanStrBoundedSSE2(p, end);
+}
+#endif
+
+typedef const char* (*ScanStrFunc)(const char*);
+typedef const char* (*ScanStrBoundedFunc)(const char*, const char*);
+
+static ScanStrFunc pickScanStr() {
+    switch (simd_level()) {
+#ifdef JSONC_X86
+    case SimdLevel::AVX2: return scanStrAVX2;
+    case SimdLevel::SSE2: return scanStrSSE2;
+#endif
+    default: return scanStrScalar;
+    }
+}
+
+static ScanStrBoundedFunc pickScanStrBounded() {
+    switch (simd_level()) {
+#ifdef JSONC_X86
+    case SimdLevel::AVX2: return scanStrBoundedAVX2;
+    case SimdLevel::SSE2: return scanStrBoundedSSE2;
+#endif
+    default: return scanStrBoundedScalar;
+    }
+}
+
+const char* jsonc::scan_str(const char* p) {
+    static ScanStrFunc func = pickScanStr();
+    return func(p);
+}
+
+const char* jsonc::scan_str(const char* p, const char* end) {
+    static ScanStrBoundedFunc func = pickScanStrBounded();
+    return func(p, end);
+}
+
+/////////////////////////////////////////////////////////////////
+// Bracket scan
+/////////////////////////////////////////////////////////////////
+
+static inline bool isBracket(char c) {
+    return c == '"' || c == '{' || c == '}' || c == '[' || c == ']';
+}
+
+static const char* scanBracketsScalar(const char* p, const char* end) {
+    while (p < end && !isBracket(*p)) ++p;
+    return p;
+}
+
+#ifdef JSONC_X86
+JSONC_TARGET_SSE2
+static const char* scanBracketsSSE2(const char* p, const char* end) {
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i braceOpen = _mm_set1_epi8('{');
+    const __m128i braceClose = _mm_set1_epi8('}');
+    const __m128i lower = _mm_set1_epi8(0x20);
+    for (; end - p >= 16; p += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)p);
+        //'[' | 0x20 == '{' and ']' | 0x20 == '}'
+        __m128i vl = _mm_or_si128(v, lower);
+        __m128i hit = _mm_or_si128(_mm_cmpeq_epi8(v, quote),
+            _mm_or_si128(_mm_cmpeq_epi8(vl, braceOpen), _mm_cmpeq_epi8(vl, braceClose)));
+        unsigned mask = (unsigned)_mm_movemask_epi8(hit);
+        if (mask) return p + ctz64(mask);
+    }
+    return scanBracketsScalar(p, end);
+}
+
+JSONC_TARGET_AVX2
+static const char* scanBracketsAVX2(const char* p, const char* end) {
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i braceOpen = _mm256_set1_epi8('{');
+    const __m256i braceClose = _mm256_set1_epi8('}');
+    const __m256i lower = _mm256_set1_epi8(0x20);
+    for (; end - p >= 32; p += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)p);
+        __m256i vl = _mm256_or_si256(v, lower);
+        __m256i hit = _mm256_or_si256(_mm256_cmpeq_epi8(v, quote),
+            _mm256_or_si256(_mm256_cmpeq_epi8(vl, braceOpen), _mm256_cmpeq_epi8(vl, braceClose)));
+        uint64_t mask = (uint32_t)_mm256_movemask_epi8(hit);
+        if (mask) return p + ctz64(mask);
+    }
+    return scanBracketsSSE2(p, end);
+}
+#endif
+
+static ScanStrBoundedFunc pickScanBrackets() {
+    switch (simd_level()) {
+#ifdef JSONC_X86
+    case SimdLevel::AVX2: return scanBracketsAVX2;
+    case SimdLevel::SSE2: return scanBracketsSSE2;
+#endif
+    default: return scanBracketsScalar;
+    }
+}
+
+const char* jsonc::scan_brackets(const char* p, const char* end) {
+    static ScanStrBoundedFunc func = pickScanBrackets();
+    return func(p, end);
+}
+
+/////////////////////////////////////////////////////////////////
+// Classify 64 bytes
+/////////////////////////////////////////////////////////////////
+
+namespace {
+
+struct BlockMasks {
+    uint64_t quote;
+    uint64_t backslash;
+    uint64_t op;
+    uint64_t space;
+};
+
+struct Stage1State {
+    uint64_t prevOddBackslash;
+    uint64_t prevInString;
+    uint64_t prevScalar;
+};
+
+}
+
+static void classifyScalar(const char* p, BlockMasks& m) {
+    m.quote = m.backslash = m.op = m.space = 0;
+    for (int i = 0; i < 64; ++i) {
+        uint64_t bit = 1ULL << i;
+        switch (p[i]) {
+        case '"': m.quote |= bit; break;
+        case '\\': m.backslash |= bit; break;
+        case '{': case '}': case '[': case ']': case ':': case ',':
+            m.op |= bit; break;
+        case ' ': case '\t': case '\n': case '\r':
+            m.space |= bit; break;
+        default: break;
+        }
+    }
+}
+
+#ifdef JSONC_X86
+JSONC_TARGET_SSE2
+static inline void classifySSE2(const char* p, BlockMasks& m) {
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i braceOpen = _mm_set1_epi8('{');
+    const __m128i braceClose = _mm_set1_epi8('}');
+    const __m128i lower = _mm_set1_epi8(0x20);
+    const __m128i colon = _mm_set1_epi8(':');
+    const __m128i comma = _mm_set1_epi8(',');
+    const __m128i sp = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i nl = _mm_set1_epi8('\n');
+    const __m128i cr = _mm_set1_epi8('\r');
+    m.quote = m.backslash = m.op = m.space = 0;
+    for (int i = 0; i < 4; ++i) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(p + i * 16));
+        //'[' | 0x20 == '{' and ']' | 0x20 == '}'
+        __m128i vl = _mm_or_si128(v, lower);
+        __m128i op = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(vl, braceOpen), _mm_cmpeq_epi8(vl, braceClose)),
+            _mm_or_si128(_mm_cmpeq_epi8(v, colon), _mm_cmpeq_epi8(v, comma)));
+        __m128i space = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, sp), _mm_cmpeq_epi8(v, tab)),
+            _mm_or_si128(_mm_cmpeq_epi8(v, nl), _mm_cmpeq_epi8(v, cr)));
+        int shift = i * 16;
+        m.quote |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, quote)) << shift;
+        m.backslash |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, backslash)) << shift;
+        m.op |= (uint64_t)(uint16_t)_mm_movemask_epi8(op) << shift;
+        m.space |= (uint64_t)(uint16_t)_mm_movemask_epi8(space) << shift;
+    }
+}
+
+JSONC_TARGET_AVX2
+static inline void classifyAVX2(const char* p, BlockMasks& m) {
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i backslash = _mm256_set1_epi8('\\');
+    const __m256i braceOpen = _mm256_set1_epi8('{');
+    const __m256i braceClose = _mm256_set1_epi8('}');
+    const __m256i lower = _mm256_set1_epi8(0x20);
+    const __m256i colon = _mm256_set1_epi8(':');
+    const __m256i comma = _mm256_set1_epi8(',');
+    const __m256i sp = _mm256_set1_epi8(' ');
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i nl = _mm256_set1_epi8('\n');
+    const __m256i cr = _mm256_set1_epi8('\r');
+    m.quote = m.backslash = m.op = m.space = 0;
+    for (int i = 0; i < 2; ++i) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(p + i * 32));
+        __m256i vl = _mm256_or_si256(v, lower);
+        __m256i op = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(vl, braceOpen), _mm256_cmpeq_epi8(vl, braceClose)),
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, colon), _mm256_cmpeq_epi8(v, comma)));
+        __m256i space = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, sp), _mm256_cmpeq_epi8(v, tab)),
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, nl), _mm256_cmpeq_epi8(v, cr)));
+        int shift = i * 32;
+        m.quote |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, quote)) << shift;
+        m.backslash |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, backslash)) << shift;
+        m.op |= (uint64_t)(uint32_t)_mm256_movemask_epi8(op) << shift;
+        m.space |= (uint64_t)(uint32_t)_mm256_movemask_epi8(space) << shift;
+    }
+}
+#endif
+
+/////////////////////////////////////////////////////////////////
+// Bit tricks
+/////////////////////////////////////////////////////////////////
+
+/**
+* Characters preceded by an odd number of backslashes.
+*/
+static inline uint64_t findEscaped(uint64_t bs, uint64_t& prevOdd) {
+    const uint64_t evenBits = 0x5555555555555555ULL;
+    const uint64_t oddBits = ~evenBits;
+    uint64_t startEdges = bs & ~(bs << 1);
+    uint64_t evenStartMask = evenBits ^ prevOdd;
+    uint64_t evenStarts = startEdges & evenStartMask;
+    uint64_t oddStarts = startEdges & ~evenStartMask;
+    uint64_t evenCarries = bs + evenStarts;
+    uint64_t oddCarries = bs + oddStarts;
+    bool endsOdd = oddCarries < bs;
+    oddCarries |= prevOdd;
+    prevOdd = endsOdd ? 1 : 0;
+    uint64_t evenCarryEnds = evenCarries & ~bs;
+    uint64_t oddCarryEnds = oddCarries & ~bs;
+    return (evenCarryEnds & oddBits) | (oddCarryEnds & evenBits);
+}
+
+static inline uint64_t prefixXor(uint64_t x) {
+    x ^= x << 1;
+    x ^= x << 2;
+    x ^= x << 4;
+    x ^= x << 8;
+    x ^= x << 16;
+    x ^= x << 32;
+    return x;
+}
+
+static inline uint32_t* processBlock(const BlockMasks& m, Stage1State& s, uint32_t base, uint32_t* out) {
+    uint64_t escaped = findEscaped(m.backslash, s.prevOddBackslash);
+    uint64_t quote = m.quote & ~escaped;
+    uint64_t inString = prefixXor(quote) ^ s.prevInString;
+    s.prevInString = (uint64_t)((int64_t)inString >> 63);
+
+    uint64_t scalar = ~(m.op | m.space | quote | inString);
+    uint64_t scalarStart = scalar & ~((scalar << 1) | s.prevScalar);
+    s.prevScalar = scalar >> 63;
+
+    uint64_t bits = (m.op & ~inString) | (quote & inString) | scalarStart;
+    while (bits) {
+        *out++ = base + ctz64(bits);
+        bits &= bits - 1;
+    }
+    return out;
+}
+
+static uint32_t* processTail(const char* p, size_t n, Stage1State& s, uint32_t base, uint32_t* out) {
+    char buf[64];
+    memset(buf, ' ', 64);
+    memcpy(buf, p, n);
+    BlockMasks m;
+    classifyScalar(buf, m);
+    return processBlock(m, s, base, out);
+}
+
+static uint32_t* stage1Scalar(const char* src, size_t len, Stage1State& s, uint32_t* out) {
+    size_t i = 0;
+    for (; i + 64 <= len; i += 64) {
+        BlockMasks m;
+        classifyScalar(src + i, m);
+        out = processBlock(m, s, (uint32_t)i, out);
+    }
+    if (i < len) out = processTail(src + i, len - i, s, (uint32_t)i, out);
+    return out;
+}
+
+#ifdef JSONC_X86
+JSONC_TARGET_SSE2
+static uint32_t* stage1SSE2(const char* src, size_t len, Stage1State& s, uint32_t* out) {
+    size_t i = 0;
+    for (; i + 64 <= len; i += 64) {
+        BlockMasks m;
+        classifySSE2(src + i, m);
+        out = processBlock(m, s, (uint32_t)i, out);
+    }
+    if (i < len) out = processTail(src + i, len - i, s, (uint32_t)i, out);
+    return out;
+}
+
+JSONC_TARGET_AVX2
+static uint32_t* stage1AVX2(const char* src, size_t len, Stage1State& s, uint32_t* out) {
+    size_t i = 0;
+    for (; i + 64 <= len; i += 64) {
+        BlockMasks m;
+        classifyAVX2(src + i, m);
+        out = processBlock(m, s, (uint32_t)i, out);
+    }
+    if (i < len) out = processTail(src + i, len - i, s, (uint32_t)i, out);
+    return out;
+}
+#endif
+
+/////////////////////////////////////////////////////////////////
+// Quote parity
+/////////////////////////////////////////////////////////////////
+
+static inline int blockQuotes(const BlockMasks& m, uint64_t& prevOdd) {
+    return popcount64(m.quote & ~findEscaped(m.backslash, prevOdd));
+}
+
+static int tailQuotes(const char* p, size_t n, uint64_t& prevOdd) {
+    char buf[64];
+    memset(buf, ' ', 64);
+    memcpy(buf, p, n);
+    BlockMasks m;
+    classifyScalar(buf, m);
+    return blockQuotes(m, prevOdd);
+}
+
+static bool quoteParityScalar(const char* src, size_t len, uint64_t prevOdd) {
+    int n = 0;
+    size_t i = 0;
+    for (; i + 64 <= len; i += 64) {
+        BlockMasks m;
+        classifyScalar(src + i, m);
+        n += blockQuotes(m, prevOdd);
+    }
+    if (i < len) n += tailQuotes(src + i, len - i, prevOdd);
+    return n & 1;
+}
+
+#ifdef JSONC_X86
+JSONC_TARGET_SSE2
+static bool quoteParitySSE2(const char* src, size_t len, uint64_t prevOdd) {
+    int n = 0;
+    size_t i = 0;
+    for (; i + 64 <= len; i += 64) {
+        BlockMasks m;
+        classifySSE2(src + i, m);
+        n += blockQuotes(m, prevOdd);
+    }
+    if (i < len) n += tailQuotes(src + i, len - i, prevOdd);
+    return n & 1;
+}
+
+JSONC_TARGET_AVX2
+static bool quoteParityAVX2(const char* src, size_t len, uint64_t prevOdd) {
+    int n = 0;
+    size_t i = 0;
+    for (; i + 64 <= len; i += 64) {
+        BlockMasks m;
+        classifyAVX2(src + i, m);
+        n += blockQuotes(m, prevOdd);
+    }
+    if (i < len) n += tailQuotes(src + i, len - i, prevOdd);
+    return n & 1;
+}
+#endif
+
+bool jsonc::quote_parity(const char* p, size_t len, bool escaped) {
+    switch (simd_level()) {
+#ifdef JSONC_X86
+    case SimdLevel::AVX2: return quoteParityAVX2(p, len, escaped);
+    case SimdLevel::SSE2: return quoteParitySSE2(p, len, escaped);
+#endif
+    default: return quoteParityScalar(p, len, escaped);
+    }
+}
+
+/////////////////////////////////////////////////////////////////
+// StructuralIndex
+/////////////////////////////////////////////////////////////////
+
+StructuralIndex::~StructuralIndex() {
+    free(positions);
+}
+
+IndexStatus StructuralIndex::build(const char* src, size_t len) {
+    count = 0;
+    if (len >= UINT32_MAX) return IndexStatus::TooLarge;
+
+    //at most one structural per byte, plus slack for the padded tail block
+    if (capacity < len + 64) {
+        free(positions);
+        capacity = len + 64;
+        positions = (uint32_t*)malloc(capacity * sizeof(uint32_t));
+        if (!positions) {
+            capacity = 0;
+            return IndexStatus::NoMemory;
+        }
+    }
+
+    Stage1State s = { 0, 0, 0 };
+    uint32_t* out = positions;
+    switch (simd_level()) {
+#ifdef JSONC_X86
+    case SimdLevel::AVX2: out = stage1AVX2(src, len, s, out); break;
+    case SimdLevel::SSE2: out = stage1SSE2(src, len, s, out); break;
+#endif
+    default: out = stage1Scalar(src, len, s, out); break;
+    }
+    count = out - positions;
+    return s.prevInString == 0 ? IndexStatus::Ok : IndexStatus::InString;
+}
+
+/////////////////////////////////////////////////////////////////
+// UTF-8 validation
+/////////////////////////////////////////////////////////////////
+
+/**
+* Length of the multibyte sequence at p, 0 if malformed.
+* The allowed range of the second byte excludes overlongs, surrogates and
+* code points above U+10FFFF.
+*/
+static inline int utf8Sequence(const uint8_t* p, const uint8_t* end) {
+    uint8_t c = *p;
+    int n;
+    uint8_t lo = 0x80, hi = 0xBF;
+    if (c >= 0xC2 && c <= 0xDF) {
+        n = 2;
+    }
+    else if (c >= 0xE0 && c <= 0xEF) {
+        n = 3;
+        if (c == 0xE0) lo = 0xA0;
+        else if (c == 0xED) hi = 0x9F;
+    }
+    else if (c >= 0xF0 && c <= 0xF4) {
+        n = 4;
+        if (c == 0xF0) lo = 0x90;
+        else if (c == 0xF4) hi = 0x8F;
+    }
+    else {
+        return 0;
+    }
+    if (end - p < n || p[1] < lo || p[1] > hi) return 0;
+    for (int i = 2; i < n; ++i) {
+        if ((p[i] & 0xC0) != 0x80) return 0;
+    }
+    return n;
+}
+
+static const char* utf8Scalar(const char* s, const char* e) {
+    const uint8_t* p = (const uint8_t*)s;
+    const uint8_t* end = (const uint8_t*)e;
+    while (p < end) {
+        if (end - p >= 8) {
+            uint64_t w;
+            memcpy(&w, p, 8);
+            if (!(w & 0x8080808080808080ULL)) {
+                p += 8;
+                continue;
+            }
+        }
+        if (*p < 0x80) {
+            ++p;
+            continue;
+        }
+        int n = utf8Sequence(p, end);
+        if (!n) return (const char*)p;
+        p += n;
+    }
+    return e;
+}
+
+/**
+* A block failed, locate the exact byte. Everything before block was valid,
+* so restart at the last lead byte in front of it.
+*/
+static const char* utf8Locate(const char* begin, const char* block, const char* end) {
+    const char* p = block;
+    for (int i = 0; i < 3 && p > begin && ((uint8_t)p[-1] & 0xC0) == 0x80; ++i) --p;
+    if (p > begin && (uint8_t)p[-1] >= 0xC0) --p;
+    return utf8Scalar(p, end);
+}
+
+#ifdef JSONC_X86
+JSONC_TARGET_SSE2
+static const char* utf8SSE2(const char* s, const char* e) {
+    //vector ASCII skip, multibyte sequences are checked one by one
+    const uint8_t* p = (const uint8_t*)s;
+    const uint8_t* end = (const uint8_t*)e;
+    while (end - p >= 16) {
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)p));
+        if (!mask) {
+            p += 16;
+            continue;
+        }
+        p += ctz64(mask);
+        int n = utf8Sequence(p, end);
+        if (!n) return (const char*)p;
+        p += n;
+    }
+    return utf8Scalar((const char*)p, e);
+}
+
+/**
+* Lookup table validation of 32 bytes at a time (Keiser and Lemire,
+* "Validating UTF-8 In Less Than One Instruction Per Byte").
+*/
+JSONC_TARGET_AVX2
+static inline __m256i utf8Prev(__m256i input, __m256i prevInput, int n) {
+    __m256i shifted = _mm256_permute2x128_si256(prevInput, input, 0x21);
+    switch (n) {
+    case 1: return _mm256_alignr_epi8(input, shifted, 15);
+    case 2: return _mm256_alignr_epi8(input, shifted, 14);
+    default: return _mm256_alignr_epi8(input, shifted, 13);
+    }
+}
+
+JSONC_TARGET_AVX2
+static inline __m256i utf8Lookup(__m256i idx, __m256i table) {
+    return _mm256_shuffle_epi8(table, idx);
+}
+
+JSONC_TARGET_AVX2
+static inline __m256i utf8BlockError(__m256i input, __m256i prevInput) {
+    const int8_t TOO_SHORT = 1 << 0;
+    const int8_t TOO_LONG = 1 << 1;
+    const int8_t OVERLONG_3 = 1 << 2;
+    const int8_t TOO_LARGE = 1 << 3;
+    const int8_t SURROGATE = 1 << 4;
+    const int8_t OVERLONG_2 = 1 << 5;
+    const int8_t TOO_LARGE_1000 = 1 << 6;
+    const int8_t OVERLONG_4 = 1 << 6;
+    const int8_t TWO_CONTS = (int8_t)(1 << 7);
+    const int8_t CARRY = TOO_SHORT | TOO_LONG | TWO_CONTS;
+
+    const __m256i byte1High = _mm256_setr_epi8(
+        TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+        TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+        TOO_SHORT | OVERLONG_2, TOO_SHORT, TOO_SHORT | OVERLONG_3 | SURROGATE,
+        TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4,
+        TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+        TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+        TOO_SHORT | OVERLONG_2, TOO_SHORT, TOO_SHORT | OVERLONG_3 | SURROGATE,
+        TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4);
+    const int8_t L = CARRY | TOO_LARGE | TOO_LARGE_1000;
+    const __m256i byte1Low = _mm256_setr_epi8(
+        CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4, CARRY | OVERLONG_2, CARRY, CARRY,
+        CARRY | TOO_LARGE, L, L, L, L, L, L, L, L, L | SURROGATE, L, L,
+        CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4, CARRY | OVERLONG_2, CARRY, CARRY,
+        CARRY | TOO_LARGE, L, L, L, L, L, L, L, L, L | SURROGATE, L, L);
+    const int8_t C = TOO_LONG | OVERLONG_2 | TWO_CONTS;
+    const __m256i byte2High = _mm256_setr_epi8(
+        TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+        C | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4, C | OVERLONG_3 | TOO_LARGE,
+        C | SURROGATE | TOO_LARGE, C | SURROGATE | TOO_LARGE,
+        TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+        TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+        C | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4, C | OVERLONG_3 | TOO_LARGE,
+        C | SURROGATE | TOO_LARGE, C | SURROGATE | TOO_LARGE,
+        TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT);
+
+    const __m256i lowNibble = _mm256_set1_epi8(0x0F);
+    __m256i prev1 = utf8Prev(input, prevInput, 1);
+    __m256i special = _mm256_and_si256(
+        _mm256_and_si256(
+            utf8Lookup(_mm256_and_si256(_mm256_srli_epi16(prev1, 4), lowNibble), byte1High),
+            utf8Lookup(_mm256_and_si256(prev1, lowNibble), byte1Low)),
+        utf8Lookup(_mm256_and_si256(_mm256_srli_epi16(input, 4), lowNibble), byte2High));
+
+    //third and fourth bytes of a sequence must be continuations
+    __m256i prev2 = utf8Prev(input, prevInput, 2);
+    __m256i prev3 = utf8Prev(input, prevInput, 3);
+    __m256i must23 = _mm256_or_si256(
+        _mm256_subs_epu8(prev2, _mm256_set1_epi8((char)(0xE0 - 0x80))),
+        _mm256_subs_epu8(prev3, _mm256_set1_epi8((char)(0xF0 - 0x80))));
+    __m256i must23x80 = _mm256_and_si256(must23, _mm256_set1_epi8((char)0x80));
+    return _mm256_xor_si256(must23x80, special);
+}
+
+JSONC_TARGET_AVX2
+static const char* utf8AVX2(const char* begin, const char* end) {
+    //non zero where a multibyte sequence runs past the block
+    const __m256i maxValue = _mm256_setr_epi8(
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        (char)(0xF0 - 1), (char)(0xE0 - 1), (char)(0xC0 - 1));
+    __m256i prevInput = _mm256_setzero_si256();
+    __m256i prevIncomplete = _mm256_setzero_si256();
+    const char* p = begin;
+    while (p < end) {
+        __m256i input;
+        if (end - p >= 32) {
+            input = _mm256_loadu_si256((const __m256i*)p);
+        }
+        else {
+            //pad the tail with ASCII
+            char buf[32];
+            memset(buf, 0, 32);
+            memcpy(buf, p, end - p);
+            input = _mm256_loadu_si256((const __m256i*)buf);
+        }
+        __m256i error;
+        if (_mm256_movemask_epi8(input) == 0) {
+            error = prevIncomplete;
+            prevIncomplete = _mm256_setzero_si256();
+        }
+        else {
+            error = utf8BlockError(input, prevInput);
+            prevIncomplete = _mm256_subs_epu8(input, maxValue);
+        }
+        if (!_mm256_testz_si256(error, error)) return utf8Locate(begin, p, end);
+        prevInput = input;
+        p += 32;
+    }
+    if (!_mm256_testz_si256(prevIncomplete, prevIncomplete)) {
+        return utf8Locate(begin, p - 32, end);
+    }
+    return end;
+}
+#endif
+
+static ScanStrBoundedFunc pickUtf8() {
+    switch (simd_level()) {
+#ifdef JSONC_X86
+    case SimdLevel::AVX2: return utf8AVX2;
+    case SimdLevel::SSE2: return utf8SSE2;
+#endif
+    default: return utf8Scalar;
+    }
+}
+
+const char* jsonc::validate_utf8(const char* p, const char* end) {
+    static ScanStrBoundedFunc func = pickUtf8();
+    return func(p, end);
+}
@@ -0,0 +1,128 @@
+//
+// Licensed under the GNU LESSER GENERAL PUBLIC LICENSE version 3.0
+//  Created by Jed Young on 17/4/30.
+//  Copyright © 2017 chunquedong. All rights reserved.
+//
+
+
+#ifndef jsimd_hpp
+#define jsimd_hpp
+
+#include <inttypes.h>
+#include <stddef.h>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define JSONC_X86 1
+#endif
+
+//loads that never cross a page, but may read past the end of the allocation
+#if defined(__GNUC__) || defined(__clang__)
+#define JSONC_NO_SANITIZE __attribute__((no_sanitize_address))
+#else
+#define JSONC_NO_SANITIZE
+#endif
+
+namespace jsonc {
+
+    enum class SimdLevel : uint8_t {
+        Scalar,
+        SSE2,
+        AVX2,
+    };
+
+    /**
+    * Best instruction set supported by the running CPU, detected once.
+    */
+    SimdLevel simd_level();
+
+    inline int ctz64(uint64_t x) {
+#if defined(_MSC_VER) && defined(_M_X64)
+        unsigned long i;
+        _BitScanForward64(&i, x);
+        return (int)i;
+#elif defined(_MSC_VER)
+        unsigned long i;
+        if (_BitScanForward(&i, (uint32_t)x)) return (int)i;
+        _BitScanForward(&i, (uint32_t)(x >> 32));
+        return (int)i + 32;
+#else
+        return __builtin_ctzll(x);
+#endif
+    }
+
+    inline int popcount64(uint64_t x) {
+#if defined(_MSC_VER)
+        x = x - ((x >> 1) & 0x5555555555555555ULL);
+        x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+        x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+        return (int)((x * 0x0101010101010101ULL) >> 56);
+#else
+        return __builtin_popcountll(x);
+#endif
+    }
+
+    /**
+    * First '"', '\\' or control character (NUL included) at or after p.
+    * Only aligned blocks are loaded, so the scan never touches an unmapped page.
+    */
+    const char* scan_str(const char* p);
+
+    /**
+    * Same as scan_str, bounded by end. Returns end if there is none.
+    */
+    const char* scan_str(const char* p, const char* end);
+
+    /**
+    * First '"', '{', '}', '[' or ']' in [p, end), or end.
+    */
+    const char* scan_brackets(const char* p, const char* end);
+
+    /**
+    * First byte of [p, end) that starts a malformed UTF-8 sequence, or end.
+    */
+    const char* validate_utf8(const char* p, const char* end);
+
+    /**
+    * True if [p, p + len) holds an odd number of unescaped quotes.
+    * escaped: p[0] follows an odd run of backslashes.
+    */
+    bool quote_parity(const char* p, size_t len, bool escaped);
+
+    enum class IndexStatus : uint8_t {
+        Ok,
+        /** the input ends inside a string */
+        InString,
+        /** offsets are 32 bit, the input must be shorter than 4GB */
+        TooLarge,
+        NoMemory,
+    };
+
+    /**
+    * Stage one of the two-stage parser.
+    * Offsets of every structural character ({}[]:,), every opening quote
+    * and the first byte of every number/literal outside of strings.
+    * The buffer is kept for the next build.
+    */
+    class StructuralIndex {
+        uint32_t* positions;
+        size_t count;
+        size_t capacity;
+    public:
+        StructuralIndex() : positions(NULL), count(0), capacity(0) {}
+        ~StructuralIndex();
+
+        IndexStatus build(const char* src, size_t len);
+
+        const uint32_t* data() const { return positions; }
+        size_t size() const { return count; }
+    private:
+        StructuralIndex(const StructuralIndex&);
+        StructuralIndex& operator=(const StructuralIndex&);
+    };
+}
+
+#endif /* jsimd_hpp */
@@ -0,0 +1,59 @@
+//
+// Licensed under the GNU LESSER GENERAL PUBLIC LICENSE version 3.0
+//  Created by Jed Young on 17/4/30.
+//  Copyright © 2017 chunquedong. All rights reserved.
+//
+
+
+#include "jsplit.hpp"
+#include "jsimd.hpp"
+#include <thread>
+
+using namespace jsonc;
+
+void jsonc::parallel_run(int n, const std::function<void(int)>& fn) {
+    if (n <= 1) {
+        fn(0);
+        return;
+    }
+    std::vector<std::thread> workers;
+    workers.reserve(n - 1);
+    for (int i = 1; i < n; ++i) {
+        workers.push_back(std::thread(fn, i));
+    }
+    fn(0);
+    for (size_t i = 0; i < workers.size(); ++i) {
+        workers[i].join();
+    }
+}
+
+int jsonc::thread_count(size_t len, int maxThreads, size_t minChunk) {
+    if (maxThreads <= 0) {
+        maxThreads = (int)std::thread::hardware_concurrency();
+        if (maxThreads <= 0) maxThreads = 1;
+    }
+    size_t n = len / minChunk + 1;
+    return n < (size_t)maxThreads ? (int)n : maxThreads;
+}
+
+bool jsonc::is_escaped(const char* src, size_t pos) {
+    size_t n = 0;
+    while (pos > n && src[pos - n - 1] == '\\') ++n;
+    return n & 1;
+}
+
+void jsonc::string_states(const char* src, size_t len, const std::vector<size_t>& starts, std::vector<char>& inString) {
+    int n = (int)starts.size();
+    std::vector<char> parity(n);
+    parallel_run(n, [&](int i) {
+        size_t begin = starts[i];
+        size_t end = i + 1 < n ? starts[i + 1] : len;
+        parity[i] = quote_parity(src + begin, end - begin, is_escaped(src, begin));
+    });
+    inString.resize(n);
+    char state = 0;
+    for (int i = 0; i < n; ++i) {
+        inString[i] = state;
+        state ^= parity[i];
+    }
+}
@@ -0,0 +1,40 @@
+//
+// Licensed under the GNU LESSER GENERAL PUBLIC LICENSE version 3.0
+//  Created by Jed Young on 17/4/30.
+//  Copyright © 2017 chunquedong. All rights reserved.
+//
+
+
+#ifndef jsplit_hpp
+#define jsplit_hpp
+
+#include <stddef.h>
+#include <vector>
+#include <functional>
+
+namespace jsonc {
+
+    /**
+    * Run fn(0) .. fn(n-1), each on its own thread. n == 1 runs inline.
+    */
+    void parallel_run(int n, const std::function<void(int)>& fn);
+
+    /**
+    * Number of threads to use for len bytes: at most maxThreads
+    * (0: hardware concurrency) and at least minChunk bytes each.
+    */
+    int thread_count(size_t len, int maxThreads, size_t minChunk);
+
+    /**
+    * True if the byte at pos follows an odd run of backslashes.
+    */
+    bool is_escaped(const char* src, size_t pos);
+
+    /**
+    * Whether each offset of starts (ascending, starts[0] == 0) lies inside
+    * a string. The chunks between offsets are scanned concurrently.
+    */
+    void string_states(const char* src, size_t len, const std::vector<size_t>& starts, std::vector<char>& inString);
+}
+
+#endif /* jsplit_hpp */
@@ -0,0 +1,333 @@
+//
+// Licensed under the GNU LESSER GENERAL PUBLIC LICENSE version 3.0
+//  Created by Jed Young on 17/4/30.
+//  Copyright © 2017 chunquedong. All rights reserved.
+//
+
+
+#include "jparser.hpp"
+#include "jsimd.hpp"
+#include "jnumber.hpp"
+#include "jintern.hpp"
+#include <string.h>
+#include <vector>
+#include <string>
+
+namespace jsonc {
+
+struct StreamState {
+    enum State {
+        Value,
+        ArrayFirst,
+        ObjectFirst,
+        Key,
+        Colon,
+        After,
+        String,
+        Number,
+        Literal,
+    };
+    State state;
+    bool started;
+    bool inKey;
+    bool escaped;
+    const char* key;
+    JsonNode* root;
+    size_t offset;
+    //partial string/number/literal spanning chunks
+    std::string token;
+    std::vector<BuildFrame> stack;
+
+    StreamState() { reset(); }
+
+    void reset() {
+        state = Value;
+        started = false;
+        inKey = false;
+        escaped = false;
+        key = NULL;
+        root = NULL;
+        offset = 0;
+        token.clear();
+        stack.clear();
+    }
+};
+
+}
+
+using namespace jsonc;
+
+static inline bool isNumberChar(char c) {
+    return (c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E';
+}
+
+static inline bool isLiteralChar(char c) {
+    return c >= 'a' && c <= 'z';
+}
+
+JsonParser::~JsonParser() {
+    delete stream;
+    delete index;
+}
+
+void JsonParser::streamAttach(JsonNode* val) {
+    StreamState& s = *stream;
+    if (s.stack.empty()) {
+        s.root = val;
+        s.state = StreamState::After;
+        return;
+    }
+    BuildFrame& top = s.stack.back();
+    if (top.node->_type == Type::Object) val->name = s.key;
+    top.append(val);
+    s.state = StreamState::After;
+}
+
+bool JsonParser::streamString(const char* raw, size_t len) {
+    StreamState& s = *stream;
+    if (s.inKey && keyTable && !memchr(raw, '\\', len)) {
+        //plain keys go to the table without a copy in the allocator
+        s.key = keyTable->intern(raw, len);
+        s.inKey = false;
+        s.state = StreamState::Colon;
+        return true;
+    }
+    char* str = copyStr(raw, len);
+    if (!str) return false;
+
+    if (s.inKey) {
+        s.key = internKey(str);
+        s.inKey = false;
+        s.state = StreamState::Colon;
+    }
+    else {
+        JsonNode* val = alloc(Type::String);
+        val->value.str = str;
+        streamAttach(val);
+    }
+    return true;
+}
+
+bool JsonParser::streamScalar() {
+    StreamState& s = *stream;
+    const char* tok = s.token.c_str();
+    const char* tokEnd = tok + s.token.size();
+    JsonNode* val;
+    if (s.state == StreamState::Number) {
+        val = alloc(Type::Integer);
+        bool isFloat;
+        const char* e = rawNumbers ? skip_number(tok, tokEnd, &isFloat) : parse_number(tok, tokEnd, val);
+        if (e != tokEnd) {
+            snprintf(error, 128, "Invalid number '%s' at offset %llu", tok, (unsigned long long)s.offset);
+            return false;
+        }
+        if (rawNumbers) {
+            char* str = (char*)allocator->allocate_raw(tokEnd - tok);
+            memcpy(str, tok, tokEnd - tok);
+            val->set_raw_num(str, (uint32_t)(tokEnd - tok), isFloat);
+        }
+    }
+    else if (s.token == "true" || s.token == "false") {
+        val = alloc(Type::Boolean);
+        val->value.b = s.token[0] == 't';
+    }
+    else if (s.token == "null") {
+        val = alloc(Type::Null);
+    }
+    else {
+        snprintf(error, 128, "Unexpected token '%s' at offset %llu", tok, (unsigned long long)s.offset);
+        return false;
+    }
+    s.token.clear();
+    streamAttach(val);
+    return true;
+}
+
+bool JsonParser::feed(const char* chunk, size_t len) {
+    if (!stream) stream = new StreamState();
+    StreamState& s = *stream;
+    if (!s.started) {
+        s.started = true;
+        error[0] = 0;
+    }
+    if (error[0]) return false;
+
+    const char* p = chunk;
+    const char* end = chunk + len;
+    while (p < end) {
+        char c = *p;
+        switch (s.state) {
+        case StreamState::String: {
+            const char* q = p;
+            if (s.escaped) {
+                s.escaped = false;
+                ++q;
+            }
+            while (true) {
+                q = scan_str(q, end);
+                if (q == end) break;
+                if (*q == '\\') {
+                    if (q + 1 == end) {
+                        s.escaped = true;
+                        q = end;
+                        break;
+                    }
+                    q += 2;
+                }
+                else if (*q == '"') {
+                    break;
+                }
+                else {
+                    ++q;
+                }
+            }
+            if (q == end) {
+                s.token.append(p, end - p);
+                s.offset += end - p;
+                p = end;
+                continue;
+            }
+            bool ok;
+            if (s.token.empty()) {
+                ok = streamString(p, q - p);
+            }
+            else {
+                s.token.append(p, q - p);
+                ok = streamString(s.token.data(), s.token.size());
+                s.token.clear();
+            }
+            if (!ok) return false;
+            s.offset += q + 1 - p;
+            p = q + 1;
+            continue;
+        }
+        case StreamState::Number:
+        case StreamState::Literal: {
+            const char* q = p;
+            if (s.state == StreamState::Number) {
+                while (q < end && isNumberChar(*q)) ++q;
+            }
+            else {
+                while (q < end && isLiteralChar(*q)) ++q;
+            }
+            s.token.append(p, q - p);
+            s.offset += q - p;
+            p = q;
+            if (q == end) continue;
+            if (!streamScalar()) return false;
+            continue;
+        }
+        default:
+            break;
+        }
+
+        if (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+            ++p;
+            ++s.offset;
+            continue;
+        }
+
+        switch (s.state) {
+        case StreamState::ArrayFirst:
+            if (c == ']') {
+                s.stack.pop_back();
+                s.state = StreamState::After;
+                break;
+            }
+            //fall through
+        case StreamState::Value:
+            if (c == '"') {
+                s.state = StreamState::String;
+            }
+            else if (c == '{' || c == '[') {
+                if (s.stack.size() >= maxDepth) {
+                    snprintf(error, 128, "Too deep nesting at offset %llu", (unsigned long long)s.offset);
+                    return false;
+                }
+                JsonNode* val = alloc(c == '{' ? Type::Object : Type::Array);
+                val->value.child = NULL;
+                streamAttach(val);
+                BuildFrame frame = { val, NULL };
+                s.stack.push_back(frame);
+                s.state = c == '{' ? StreamState::ObjectFirst : StreamState::ArrayFirst;
+            }
+            else if (c == '-' || (c >= '0' && c <= '9')) {
+                s.state = StreamState::Number;
+                continue;
+            }
+            else if (isLiteralChar(c)) {
+                s.state = StreamState::Literal;
+                continue;
+            }
+            else {
+                goto error;
+            }
+            break;
+        case StreamState::ObjectFirst:
+            if (c == '}') {
+                s.stack.pop_back();
+                s.state = StreamState::After;
+                break;
+            }
+            //fall through
+        case StreamState::Key:
+            if (c != '"') {
+                snprintf(error, 128, "object key must be string, got '%c' at offset %llu", c, (unsigned long long)s.offset);
+                return false;
+            }
+            s.inKey = true;
+            s.state = StreamState::String;
+            break;
+        case StreamState::Colon:
+            if (c != ':') {
+                snprintf(error, 128, "':' Expected, got '%c' at offset %llu", c, (unsigned long long)s.offset);
+                return false;
+            }
+            s.state = StreamState::Value;
+            break;
+        case StreamState::After:
+            if (s.stack.empty()) goto error;
+            if (c == ',') {
+                s.state = s.stack.back().node->_type == Type::Object ? StreamState::Key : StreamState::Value;
+            }
+            else if ((c == '}' && s.stack.back().node->_type == Type::Object) ||
+                     (c == ']' && s.stack.back().node->_type == Type::Array)) {
+                s.stack.pop_back();
+            }
+            else {
+                goto error;
+            }
+            break;
+        default:
+            break;
+        }
+        ++p;
+        ++s.offset;
+    }
+    return true;
+
+error:
+    snprintf(error, 128, "Unexpected token '%c' at offset %llu", *p, (unsigned long long)s.offset);
+    return false;
+}
+
+Value* JsonParser::finish() {
+    if (!stream) stream = new StreamState();
+    StreamState& s = *stream;
+    root = NULL;
+    if (!error[0]) {
+        if (s.state == StreamState::Number || s.state == StreamState::Literal) {
+            streamScalar();
+        }
+        if (!error[0]) {
+            if (s.state == StreamState::After && s.stack.empty()) {
+                root = s.root;
+            }
+            else {
+                snprintf(error, 128, "Unexpected end of stream");
+            }
+        }
+    }
+    s.reset();
+    return setRoot(root);
+}
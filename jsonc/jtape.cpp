@@ -0,0 +1,212 @@
+//
+// Licensed under the GNU LESSER GENERAL PUBLIC LICENSE version 3.0
+//  Created by Jed Young on 17/4/30.
+//  Copyright © 2017 chunquedong. All rights reserved.
+//
+
+
+#include "jparser.hpp"
+#include "jnumber.hpp"
+#include <stdio.h>
+#include <string.h>
+
+using namespace jsonc;
+
+namespace {
+struct TapeFrame {
+    //entry of the container
+    size_t index;
+    uint32_t count;
+};
+}
+
+Value* JsonParser::parse_tape(char* src) {
+    this->src = src;
+    cur = src;
+    error[0] = 0;
+    root = NULL;
+    tape.clear();
+    if (!parseTape()) return NULL;
+
+    Value* out = (Value*)allocator->allocate_raw(tape.size() * sizeof(Value));
+    if (!out) return NULL;
+    memcpy(out, tape.data(), tape.size() * sizeof(Value));
+    return root = out;
+}
+
+bool JsonParser::parseTape() {
+    //same grammar as parseVal, entries are appended instead of linked.
+    //Entries are addressed by index, push_back may move them.
+    FrameStack<TapeFrame> stack(allocator);
+    size_t index = 0;
+    bool open = false;
+
+value:
+    index = tape.size();
+    switch (*cur) {
+    case '"': {
+        ++cur;
+        char* str = unescape();
+        if (!str) return false;
+        tapePush(Type::String)->value.str = str;
+        goto attach;
+    }
+    case '0':
+    case '1':
+    case '2':
+    case '3':
+    case '4':
+    case '5':
+    case '6':
+    case '7':
+    case '8':
+    case '9':
+    case '-': {
+        Value* val = tapePush(Type::Integer);
+        const char* end;
+        if (rawNumbers) {
+            bool isFloat;
+            end = skip_number(cur, NULL, &isFloat);
+            if (end) val->set_raw_num(cur, (uint32_t)(end - cur), isFloat);
+        }
+        else {
+            end = parse_number(cur, NULL, val);
+        }
+        if (!end) {
+            snprintf(error, 128, "Invalid number at %s", cur);
+            return false;
+        }
+        cur = (char*)end;
+        goto attach;
+    }
+    case '{':
+    case '[': {
+        if (stack.size() >= maxDepth) {
+            snprintf(error, 128, "Too deep nesting at %s", cur);
+            return false;
+        }
+        Value* val = tapePush(*cur == '{' ? Type::Object : Type::Array);
+        val->_flag = 3;
+        val->value.tape.span = 0;
+        val->value.tape.size = 0;
+        ++cur;
+        skipWhitespace();
+        if (*cur == (val->_type == Type::Object ? '}' : ']')) {
+            ++cur;
+        }
+        else {
+            open = true;
+        }
+        goto attach;
+    }
+    case 't': {
+        //"true"
+        if (cur[1] == 'r' && cur[2] == 'u' && cur[3] == 'e') {
+            cur += 4;
+            tapePush(Type::Boolean)->value.b = true;
+            goto attach;
+        }
+        else {
+            goto error;
+        }
+    }
+    case 'f': {
+        //"false"
+        if (cur[1] == 'a' && cur[2] == 'l' && cur[3] == 's' && cur[4] == 'e') {
+            cur += 5;
+            tapePush(Type::Boolean)->value.b = false;
+            goto attach;
+        }
+        else {
+            goto error;
+        }
+    }
+    case 'n': {
+        //"null"
+        if (cur[1] == 'u' && cur[2] == 'l' && cur[3] == 'l') {
+            cur += 4;
+            tapePush(Type::Null);
+            goto attach;
+        }
+        else {
+            goto error;
+        }
+    }
+    case '\t':
+    case '\n':
+    case '\r':
+    case ' ': {
+        ++cur;
+        goto value;
+    }
+    default:
+        goto error;
+    }
+
+attach:
+    if (!stack.empty()) ++stack.back()->count;
+    if (open) {
+        open = false;
+        TapeFrame* frame = stack.push();
+        frame->index = index;
+        frame->count = 0;
+        if (tape[index]._type == Type::Object) goto key;
+        goto value;
+    }
+
+next:
+    if (stack.empty()) {
+        return true;
+    }
+    skipWhitespace();
+    {
+        TapeFrame* top = stack.back();
+        Value& container = tape[top->index];
+        if (container._type == Type::Object) {
+            if (*cur == ',') {
+                ++cur;
+                skipWhitespace();
+                goto key;
+            }
+            if (!expect('}')) return false;
+        }
+        else {
+            if (*cur == ',') {
+                ++cur;
+                goto value;
+            }
+            if (!expect(']')) return false;
+        }
+        size_t span = tape.size() - top->index - 1;
+        if (span > UINT32_MAX) {
+            snprintf(error, 128, "Document too large for a tape");
+            return false;
+        }
+        container.value.tape.span = (uint32_t)span;
+        container.value.tape.size = top->count;
+    }
+    stack.pop();
+    goto next;
+
+key:
+    if (*cur != '"') {
+        snprintf(error, 128, "object key must be string, got '%c' at %s", *cur, cur);
+        return false;
+    }
+    {
+        ++cur;
+        char* str = unescape();
+        if (!str) return false;
+        tapePush(Type::String)->value.str = (char*)internKey(str);
+    }
+    skipWhitespace();
+    if (!expect(':')) return false;
+    goto value;
+
+error:
+    if (*cur == 0) snprintf(error, 128, "Unexpected end of stream");
+    else {
+        snprintf(error, 128, "Unexpected token '%c' at %s", *cur, cur);
+    }
+    return false;
+}
@@ -0,0 +1,222 @@
+//
+// Licensed under the GNU LESSER GENERAL PUBLIC LICENSE version 3.0
+//  Created by Jed Young on 17/4/30.
+//  Copyright © 2017 chunquedong. All rights reserved.
+//
+
+
+#include "jvalidate.hpp"
+#include "jsimd.hpp"
+#include "jscan.hpp"
+#include <stdio.h>
+#include <string.h>
+
+using namespace jsonc;
+
+static inline bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static inline bool isHex(char c) {
+    return isDigit(c) || ((c & ~' ') >= 'A' && (c & ~' ') <= 'F');
+}
+
+/**
+* -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?
+* Returns the byte after the number, NULL if malformed.
+*/
+static const char* checkNumber(const char* p, const char* end) {
+    if (p < end && *p == '-') ++p;
+    if (p == end || !isDigit(*p)) return NULL;
+    if (*p == '0') ++p;
+    else while (p < end && isDigit(*p)) ++p;
+    if (p < end && *p == '.') {
+        ++p;
+        if (p == end || !isDigit(*p)) return NULL;
+        while (p < end && isDigit(*p)) ++p;
+    }
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        ++p;
+        if (p < end && (*p == '+' || *p == '-')) ++p;
+        if (p == end || !isDigit(*p)) return NULL;
+        while (p < end && isDigit(*p)) ++p;
+    }
+    return p;
+}
+
+/**
+* p after the opening quote. Returns the byte after the closing quote,
+* on error NULL with p at the bad byte.
+*/
+static const char* checkString(const char*& p, const char* end) {
+    while (true) {
+        p = scan_str(p, end);
+        if (p == end) return NULL;
+        if (*p == '"') return p + 1;
+        if (*p != '\\') return NULL;
+        if (end - p < 2) {
+            p = end;
+            return NULL;
+        }
+        switch (p[1]) {
+        case '"': case '\\': case '/': case 'b': case 'f': case 'n': case 'r': case 't':
+            p += 2;
+            break;
+        case 'u':
+            if (end - p < 6 || !isHex(p[2]) || !isHex(p[3]) || !isHex(p[4]) || !isHex(p[5])) return NULL;
+            p += 6;
+            break;
+        default:
+            return NULL;
+        }
+    }
+}
+
+static inline bool isLiteral(const char* p, const char* end, const char* word, size_t n) {
+    return (size_t)(end - p) >= n && memcmp(p, word, n) == 0;
+}
+
+bool JsonValidator::checkGrammar(const char*& p, const char* end, const char*& msg) {
+    size_t limit = maxDepth < (size_t)MaxDepthLimit ? maxDepth : (size_t)MaxDepthLimit;
+    size_t depth = 0;
+    const char* q;
+
+value:
+    p = skip_space(p, end);
+    if (p == end) goto eos;
+    switch (*p) {
+    case '{':
+    case '[': {
+        if (depth == limit) {
+            msg = "Too deep nesting";
+            return false;
+        }
+        bool isObject = *p == '{';
+        uint64_t bit = 1ULL << (depth % 64);
+        if (isObject) stack[depth / 64] |= bit;
+        else stack[depth / 64] &= ~bit;
+        ++depth;
+        p = skip_space(p + 1, end);
+        if (p < end && *p == (isObject ? '}' : ']')) {
+            --depth;
+            ++p;
+            goto next;
+        }
+        if (isObject) goto key;
+        goto value;
+    }
+    case '"':
+        ++p;
+        q = checkString(p, end);
+        if (!q) goto string;
+        p = q;
+        goto next;
+    case 't':
+        if (!isLiteral(p, end, "true", 4)) goto token;
+        p += 4;
+        goto next;
+    case 'f':
+        if (!isLiteral(p, end, "false", 5)) goto token;
+        p += 5;
+        goto next;
+    case 'n':
+        if (!isLiteral(p, end, "null", 4)) goto token;
+        p += 4;
+        goto next;
+    default:
+        q = checkNumber(p, end);
+        if (!q) goto token;
+        p = q;
+        if (p < end && (isDigit(*p) || *p == '.' || *p == 'e' || *p == 'E' || *p == '+' || *p == '-')) {
+            msg = "Invalid number";
+            return false;
+        }
+        goto next;
+    }
+
+next:
+    p = skip_space(p, end);
+    if (depth == 0) {
+        if (p != end) {
+            msg = "Unexpected content after value";
+            return false;
+        }
+        return true;
+    }
+    if (p == end) goto eos;
+    {
+        bool isObject = (stack[(depth - 1) / 64] >> ((depth - 1) % 64)) & 1;
+        if (*p == ',') {
+            ++p;
+            if (isObject) goto key;
+            goto value;
+        }
+        if (*p == (isObject ? '}' : ']')) {
+            ++p;
+            --depth;
+            goto next;
+        }
+    }
+    goto token;
+
+key:
+    p = skip_space(p, end);
+    if (p == end) goto eos;
+    if (*p != '"') {
+        msg = "object key must be string";
+        return false;
+    }
+    ++p;
+    q = checkString(p, end);
+    if (!q) goto string;
+    p = skip_space(q, end);
+    if (p == end) goto eos;
+    if (*p != ':') {
+        msg = "':' Expected";
+        return false;
+    }
+    ++p;
+    goto value;
+
+string:
+    if (p == end) goto eos;
+    msg = *p == '\\' ? "Invalid escape" : "Control character in string";
+    return false;
+token:
+    if (p == end) goto eos;
+    msg = "Unexpected token";
+    return false;
+eos:
+    msg = "Unexpected end of stream";
+    p = end;
+    return false;
+}
+
+bool JsonValidator::validate(const char* data, size_t len) {
+    const char* end = data + len;
+    const char* msg = NULL;
+    error[0] = 0;
+    errorOffset = 0;
+
+    //both passes stop at their first error, the earlier one is reported.
+    //bad is end when the input is cut short, so it can't tell success apart
+    const char* bad = data;
+    bool ok = checkGrammar(bad, end, msg);
+    if (ok) bad = end;
+    const char* badUtf8 = validate_utf8(data, bad);
+    if (badUtf8 != bad) {
+        ok = false;
+        bad = badUtf8;
+        msg = "Invalid UTF-8";
+    }
+    if (ok) return true;
+
+    errorOffset = bad - data;
+    if (bad < end) {
+        snprintf(error, 128, "%s at offset %llu", msg, (unsigned long long)errorOffset);
+    }
+    else {
+        snprintf(error, 128, "%s", msg);
+    }
+    return false;
+}
@@ -0,0 +1,51 @@
+//
+// Licensed under the GNU LESSER GENERAL PUBLIC LICENSE version 3.0
+//  Created by Jed Young on 17/4/30.
+//  Copyright © 2017 chunquedong. All rights reserved.
+//
+
+
+#ifndef jvalidate_hpp
+#define jvalidate_hpp
+
+#include <inttypes.h>
+#include <stddef.h>
+
+namespace jsonc {
+
+    /*
+    * Strict RFC 8259 check of a document without building anything.
+    * Grammar, nesting depth and UTF-8 are checked, no memory is allocated.
+    */
+    class JsonValidator {
+    public:
+        enum { MaxDepthLimit = 4096 };
+    private:
+        //one bit per open container, set for object
+        uint64_t stack[MaxDepthLimit / 64];
+        size_t errorOffset;
+        char error[128];
+    public:
+        /** nesting deeper than this is an error, at most MaxDepthLimit */
+        size_t maxDepth = 1024;
+
+        JsonValidator() : errorOffset(0) {
+            error[0] = 0;
+        }
+
+        /**
+        * Returns true if data is exactly one JSON value, with optional whitespace around it.
+        */
+        bool validate(const char* data, size_t len);
+
+        /** Offset of the first bad byte */
+        size_t get_error_offset() { return errorOffset; }
+        const char* get_error() { return error; }
+
+    private:
+        /** On error p is left at the bad byte */
+        bool checkGrammar(const char*& p, const char* end, const char*& msg);
+    };
+}
+
+#endif /* jvalidate_hpp */
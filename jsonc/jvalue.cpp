@@ -6,9 +6,13 @@
 
 
 #include "jvalue.hpp"
+#include "jnumber.hpp"
+#include "jmemory.hpp"
+#include "jintern.hpp"
 #include <stdlib.h>
 #include <stdexcept>
 #include <assert.h>
+#include <utility>
 
 
 namespace jsonc {
@@ -17,23 +21,59 @@ namespace jsonc {
 // Allocator
 /////////////////////////////////////////////////////////////////
 
-#define JSON_BLOCK_SIZE 4096
+#define JSON_MAX_BLOCK_SIZE (1024 * 1024)
 
-void *JsonAllocator::allocate(size_t size) {
-    size = (size + 7) & ~7;
+JsonAllocator::JsonAllocator(void* buffer, size_t size, size_t blockSize)
+    : head(nullptr), spare(nullptr), blockSize(blockSize), source(nullptr),
+    requested(0), reserved(0), largeAllocs(0), highWater(0) {
+    uintptr_t begin = ((uintptr_t)buffer + 7) & ~(uintptr_t)7;
+    uintptr_t end = (uintptr_t)buffer + size;
+    if (buffer == nullptr || end < begin + sizeof(Block)) return;
+    head = (Block *)begin;
+    head->next = nullptr;
+    head->used = sizeof(Block);
+    head->size = end - begin;
+    head->source = nullptr;
+    head->external = true;
+    reserved = head->size;
+    highWater = reserved;
+}
 
-    if (head && head->used + size <= JSON_BLOCK_SIZE) {
-        char *p = (char *)head + head->used;
-        head->used += size;
-        return p;
-    }
+void *JsonAllocator::allocate(size_t size) {
+    void* p = allocate_raw(size);
+    if (p) memset(p, 0, size);
+    return p;
+}
 
+void *JsonAllocator::newBlock(size_t size) {
     size_t allocSize = sizeof(Block) + size;
-    Block *zone = (Block *)calloc(1, allocSize <= JSON_BLOCK_SIZE ? JSON_BLOCK_SIZE : allocSize);
-    if (zone == nullptr)
-        return nullptr;
+    bool large = allocSize > blockSize;
+
+    //first retained block that fits
+    Block *zone = nullptr;
+    for (Block **p = &spare; *p; p = &(*p)->next) {
+        if ((*p)->size >= allocSize) {
+            zone = *p;
+            *p = zone->next;
+            break;
+        }
+    }
+    if (zone == nullptr) {
+        size_t zoneSize = large ? allocSize : blockSize;
+        zone = (Block *)(source ? source->alloc_block(zoneSize) : malloc(zoneSize));
+        if (zone == nullptr)
+            return nullptr;
+        zone->size = zoneSize;
+        zone->source = source;
+        zone->external = false;
+        if (!large && blockSize < JSON_MAX_BLOCK_SIZE) blockSize *= 2;
+    }
     zone->used = allocSize;
-    if (allocSize <= JSON_BLOCK_SIZE || head == nullptr) {
+    reserved += zone->size;
+    if (reserved > highWater) highWater = reserved;
+    if (large) ++largeAllocs;
+    //a large block is full, keep the current one as head
+    if (!large || head == nullptr) {
         zone->next = head;
         head = zone;
     }
@@ -44,12 +84,54 @@ void *JsonAllocator::allocate(size_t size) {
     return (char *)zone + sizeof(Block);
 }
 
-JsonAllocator::~JsonAllocator() {
+void JsonAllocator::reset() {
     while (head) {
         Block *next = head->next;
-        free(head);
+        head->next = spare;
+        spare = head;
         head = next;
     }
+    requested = 0;
+    reserved = 0;
+    largeAllocs = 0;
+}
+
+AllocatorStats JsonAllocator::get_stats() {
+    AllocatorStats stats;
+    memset(&stats, 0, sizeof(stats));
+    stats.requested = requested;
+    stats.largeAllocs = largeAllocs;
+    stats.highWater = highWater;
+    for (Block *b = head; b; b = b->next) {
+        stats.reserved += b->size;
+        ++stats.blocks;
+    }
+    if (head) stats.available = head->size - head->used;
+    stats.fragmentation = stats.reserved - stats.requested - stats.available;
+    for (Block *b = spare; b; b = b->next) {
+        stats.retained += b->size;
+    }
+    return stats;
+}
+
+void JsonAllocator::trim(size_t keep) {
+    size_t kept = 0;
+    for (Block **p = &spare; *p;) {
+        Block *zone = *p;
+        if (zone->external || kept + zone->size <= keep) {
+            if (!zone->external) kept += zone->size;
+            p = &zone->next;
+            continue;
+        }
+        *p = zone->next;
+        if (zone->source) zone->source->free_block(zone, zone->size);
+        else free(zone);
+    }
+}
+
+JsonAllocator::~JsonAllocator() {
+    reset();
+    trim();
 }
 
 JsonNode* link_reverse(JsonNode* head) {
@@ -69,9 +151,215 @@ JsonNode* link_reverse(JsonNode* head) {
 }
 
 void JsonAllocator::swap(JsonAllocator& other) {
-    Block* head = this->head;
-    this->head = other.head;
-    other.head = head;
+    std::swap(head, other.head);
+    std::swap(spare, other.spare);
+    std::swap(blockSize, other.blockSize);
+    std::swap(source, other.source);
+    std::swap(requested, other.requested);
+    std::swap(reserved, other.reserved);
+    std::swap(largeAllocs, other.largeAllocs);
+    std::swap(highWater, other.highWater);
+}
+
+void JsonAllocator::merge(JsonAllocator& other) {
+    if (!other.head) return;
+    requested += other.requested;
+    reserved += other.reserved;
+    largeAllocs += other.largeAllocs;
+    if (reserved > highWater) highWater = reserved;
+    other.requested = 0;
+    other.reserved = 0;
+    other.largeAllocs = 0;
+    if (!head) {
+        head = other.head;
+        other.head = nullptr;
+        return;
+    }
+    //keep our head as the current block
+    Block* tail = other.head;
+    while (tail->next) tail = tail->next;
+    tail->next = head->next;
+    head->next = other.head;
+    other.head = nullptr;
+}
+
+/////////////////////////////////////////////////////////////////
+// Key index
+/////////////////////////////////////////////////////////////////
+
+/**
+* Open addressing table of an indexed object, the member list moves here.
+*/
+struct KeyIndex {
+    JsonNode* child;
+    uint32_t mask;
+    //followed by mask + 1 slots, NULL: empty
+    JsonNode** slots() { return (JsonNode**)(this + 1); }
+};
+
+uint32_t key_hash(const char* key) {
+    //FNV-1a
+    uint32_t h = 2166136261u;
+    for (const unsigned char* p = (const unsigned char*)key; *p; ++p) {
+        h ^= *p;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+uint32_t key_hash(const char* key, size_t len) {
+    uint32_t h = 2166136261u;
+    const unsigned char* p = (const unsigned char*)key;
+    for (size_t i = 0; i < len; ++i) {
+        h ^= p[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+//list of members, indexed or not
+static inline bool isLinked(const Value* v) {
+    return v->_flag == 0 || v->_flag == 4;
+}
+
+static void indexObject(Value* obj, size_t size, JsonAllocator* allocator) {
+    uint32_t cap = 2;
+    while (cap < size * 2) cap *= 2;
+    KeyIndex* index = (KeyIndex*)allocator->allocate_raw(sizeof(KeyIndex) + cap * sizeof(JsonNode*));
+    if (!index) return;
+    index->child = obj->value.child;
+    index->mask = cap - 1;
+    JsonNode** slots = index->slots();
+    memset(slots, 0, cap * sizeof(JsonNode*));
+    for (JsonNode* p = index->child; p; p = p->_next) {
+        uint32_t i = key_hash(p->name) & index->mask;
+        //the first of duplicate keys wins, as in a linear search
+        while (slots[i] && strcmp(slots[i]->name, p->name) != 0) i = (i + 1) & index->mask;
+        if (!slots[i]) slots[i] = p;
+    }
+    obj->value.index = index;
+    obj->_flag = 4;
+}
+
+//before the member list is changed
+static inline void unindex(Value* obj) {
+    if (obj->_flag == 4) {
+        obj->value.child = obj->value.index->child;
+        obj->_flag = 0;
+    }
+}
+
+//drop p from the table after it was unlinked, rest: the members after it
+static void unslot(KeyIndex* index, JsonNode* p, JsonNode* rest) {
+    JsonNode** slots = index->slots();
+    uint32_t mask = index->mask;
+    uint32_t i = key_hash(p->name) & mask;
+    while (slots[i] && slots[i] != p) i = (i + 1) & mask;
+    //a shadowed duplicate has no slot
+    if (!slots[i]) return;
+    //backward shift, entries after the hole move up unless it would put them before their home
+    for (uint32_t j = (i + 1) & mask; slots[j]; j = (j + 1) & mask) {
+        uint32_t home = key_hash(slots[j]->name) & mask;
+        bool stays = i <= j ? (i < home && home <= j) : (i < home || home <= j);
+        if (stays) continue;
+        slots[i] = slots[j];
+        i = j;
+    }
+    slots[i] = NULL;
+    //p was the first of its key, the next one takes over
+    for (; rest; rest = rest->_next) {
+        if (strcmp(rest->name, p->name) != 0) continue;
+        uint32_t k = key_hash(rest->name) & mask;
+        while (slots[k]) k = (k + 1) & mask;
+        slots[k] = rest;
+        return;
+    }
+}
+
+//v3 writers before version 4 left _len uninitialized, only later buffers carry key tables
+static inline bool hasKeyTable(const Value* obj) {
+    if (!obj->_len) return false;
+    const char* buffer = ((const char*)obj) - obj->value.imuInfo.selfOffset;
+    int32_t version;
+    memcpy(&version, buffer + 4, 4);
+    return version >= 4;
+}
+
+static Value* indexFind(Value* obj, const char* name) {
+    uint32_t h = key_hash(name);
+    if (obj->_flag == 4) {
+        KeyIndex* index = obj->value.index;
+        JsonNode** slots = index->slots();
+        for (uint32_t i = h & index->mask; slots[i]; i = (i + 1) & index->mask) {
+            if (strcmp(slots[i]->name, name) == 0) return slots[i];
+        }
+        return NULL;
+    }
+    //v3: the table follows the key/value offsets, member number + 1, 0: empty
+    char* buffer = ((char*)obj) - obj->value.imuInfo.selfOffset;
+    uint32_t* offsets = (uint32_t*)(obj + 1);
+    uint32_t* slots = offsets + obj->value.imuInfo.sizeOrPos * 2;
+    uint32_t mask = obj->_len - 1;
+    for (uint32_t i = h & mask; slots[i]; i = (i + 1) & mask) {
+        uint32_t m = slots[i] - 1;
+        if (strcmp(buffer + offsets[m * 2], name) == 0) return (Value*)(buffer + offsets[m * 2 + 1]);
+    }
+    return NULL;
+}
+
+/////////////////////////////////////////////////////////////////
+// Child array
+/////////////////////////////////////////////////////////////////
+
+/**
+* Children of an append() container, in order.
+*/
+struct ChildArray {
+    uint32_t size;
+    uint32_t cap;
+    //followed by cap pointers
+    JsonNode** items() { return (JsonNode**)(this + 1); }
+};
+
+//room for one more child, the list becomes an array on the first call
+static bool reserveChild(Value* obj, JsonAllocator* allocator) {
+    if (obj->_flag == 5 && obj->value.items->size < obj->value.items->cap) return true;
+    size_t size = obj->size();
+    size_t cap = size < 4 ? 8 : size * 2;
+    if (cap > UINT32_MAX) return false;
+    ChildArray* array = (ChildArray*)allocator->allocate_raw(sizeof(ChildArray) + cap * sizeof(JsonNode*));
+    if (!array) return false;
+    array->size = (uint32_t)size;
+    array->cap = (uint32_t)cap;
+    JsonNode** items = array->items();
+    if (obj->_flag == 5) {
+        //the old array stays in the arena
+        memcpy(items, obj->value.items->items(), size * sizeof(JsonNode*));
+    }
+    else {
+        size_t i = 0;
+        for (auto p = obj->begin(); p != obj->end(); ++p) {
+            items[i++] = (JsonNode*)*p;
+        }
+    }
+    obj->value.items = array;
+    obj->_flag = 5;
+    return true;
+}
+
+//back to a linked list before a list operation
+static void unvector(Value* obj) {
+    if (obj->_flag != 5) return;
+    ChildArray* array = obj->value.items;
+    JsonNode** items = array->items();
+    JsonNode* next = NULL;
+    for (uint32_t i = array->size; i > 0; --i) {
+        items[i - 1]->_next = next;
+        next = items[i - 1];
+    }
+    obj->value.child = next;
+    obj->_len = array->size;
+    obj->_flag = 0;
 }
 
 /////////////////////////////////////////////////////////////////
@@ -80,24 +368,41 @@ void JsonAllocator::swap(JsonAllocator& other) {
 
 void Value::set_int(const int64_t other) {
     set_type(Type::Integer);
+    _flag = 0;
     value.i = other;
 }
 
 void Value::set_float(const double other) {
     set_type(Type::Float);
+    _flag = 0;
     value.d = other;
 }
 
 void Value::set_bool(const bool other) {
     set_type(Type::Boolean);
+    _flag = 0;
     value.b = other;
 }
 
 void Value::set_str(char* str) {
     set_type(Type::String);
+    _flag = 0;
     value.str = str;
 }
 
+void Value::set_raw_num(const char* str, uint32_t len, bool isFloat) {
+    set_type(isFloat ? Type::Float : Type::Integer);
+    _flag = 2;
+    _len = len;
+    value.str = (char*)str;
+}
+
+static Value rawNum(const Value* v) {
+    Value num;
+    parse_number(v->value.str, v->value.str + v->_len, &num);
+    return num;
+}
+
 const char* Value::as_str(const char* defVal) {
     if (_type != Type::String) return defVal;
     if (_flag == 1) {
@@ -107,7 +412,27 @@ const char* Value::as_str(const char* defVal) {
     return value.str;
 }
 
+const char* Value::as_str(JsonAllocator* allocator) {
+    if (_type == Type::String && _flag == 6) {
+        char* str = (char*)allocator->allocate_raw(_len + 1);
+        memcpy(str, value.str, _len);
+        str[_len] = 0;
+        set_str(str);
+    }
+    return as_str();
+}
+
+size_t Value::str_len() {
+    if (_type != Type::String) return 0;
+    if (_flag == 6) return _len;
+    const char* str = as_str();
+    return str ? strlen(str) : 0;
+}
+
 int64_t Value::as_int() {
+    if (_flag == 2) {
+        return rawNum(this).as_int();
+    }
     if (_type == Type::Integer) {
         return value.i;
     }
@@ -124,6 +449,9 @@ int64_t Value::as_int() {
 }
 
 double Value::as_float() {
+    if (_flag == 2) {
+        return rawNum(this).as_float();
+    }
     if (_type == Type::Float) {
         return value.d;
     }
@@ -153,17 +481,36 @@ size_t Value::size() {
         if (_flag == 1) {
             return value.imuInfo.sizeOrPos;
         }
-        size_t count = 0;
-        for (auto p = begin(); p != end(); ++p) {
-            ++count;
+        if (_flag == 3) {
+            return value.tape.size;
         }
-        return count;
+        if (_flag == 5) {
+            return value.items->size;
+        }
+        return _len;
     }
     return 0;
 }
 
+Value* Value::at(size_t i) {
+    if (i >= size()) return NULL;
+    if (_flag == 5) return value.items->items()[i];
+    JsonIterator it = begin();
+    if (_flag == 1) {
+        it.index = (int)i;
+    }
+    else {
+        while (i--) ++it;
+    }
+    return *it;
+}
+
 Value* Value::get(const char* name) {
     if (_type == Type::Object) {
+        //v3 objects carry a table when the encoder built one
+        if (_flag == 4 || (_flag == 1 && hasKeyTable(this))) {
+            return indexFind(this, name);
+        }
         for (auto p = begin(); p != end(); ++p) {
             if (strcmp(p.get_name(), name) == 0) {
                 return *p;
@@ -173,6 +520,31 @@ Value* Value::get(const char* name) {
     return NULL;
 }
 
+Value* Value::get_interned(const char* key) {
+    if (_type != Type::Object) return NULL;
+    if (_flag == 1) return get(key);
+    if (_flag == 4) {
+        KeyIndex* index = value.index;
+        JsonNode** slots = index->slots();
+        for (uint32_t i = KeyTable::hash_of(key) & index->mask; slots[i]; i = (i + 1) & index->mask) {
+            if (slots[i]->name == key) return slots[i];
+        }
+        return NULL;
+    }
+    for (auto p = begin(); p != end(); ++p) {
+        if (p.get_name() == key) return *p;
+    }
+    return NULL;
+}
+
+Value* Value::get(const char* name, JsonAllocator* allocator) {
+    if (_type == Type::Object && _flag == 0 && allocator) {
+        size_t n = size();
+        if (n >= JSONC_INDEX_MIN_KEYS) indexObject(this, n, allocator);
+    }
+    return get(name);
+}
+
 int64_t Value::get_int(const char* name, int64_t defval) {
     Value* val = get(name);
     if (val)
@@ -204,11 +576,8 @@ const char* Value::get_str(const char* name, const char* defval) {
 
 bool JsonNode::set(const char* key, JsonNode* val) {
     assert(_type == Type::Object);
-    for (auto p = begin(); p != end(); ++p) {
-        if (strcmp(p.get_name(), key) == 0) {
-            return false;
-        }
-        //++p;
+    if (get(key)) {
+        return false;
     }
 
     insert_pair(key, val);
@@ -218,18 +587,46 @@ bool JsonNode::set(const char* key, JsonNode* val) {
 void JsonNode::insert_pair(const char* key, JsonNode* val) {
     assert(_type == Type::Object);
     val->name = key;
+    if (_flag == 4) {
+        KeyIndex* index = value.index;
+        //keep the table while it is at most half full
+        if ((_len + 1) * 2 <= index->mask + 1) {
+            val->_next = index->child;
+            index->child = val;
+            ++_len;
+            JsonNode** slots = index->slots();
+            uint32_t i = key_hash(key) & index->mask;
+            while (slots[i] && strcmp(slots[i]->name, key) != 0) i = (i + 1) & index->mask;
+            //the new member comes first, it shadows an older one of the same key
+            slots[i] = val;
+            return;
+        }
+        unindex(this);
+    }
+    unvector(this);
     val->_next = value.child;
     value.child = val;
+    ++_len;
 }
 
 void JsonNode::insert(JsonNode* val) {
     assert(_type == Type::Array);
+    unvector(this);
     val->_next = value.child;
     value.child = val;
+    ++_len;
 }
 
 void JsonNode::_append(JsonNode* val) {
     assert(_type == Type::Array);
+    if (_flag == 5 && value.items->size < value.items->cap) {
+        val->_next = NULL;
+        value.items->items()[value.items->size++] = val;
+        return;
+    }
+    unvector(this);
+    ++_len;
+    val->_next = NULL;
     JsonNode* p = value.child;
     if (!p) {
         value.child = val;
@@ -245,9 +642,105 @@ void JsonNode::_append(JsonNode* val) {
 }
 
 void JsonNode::reverse() {
+    unindex(this);
+    unvector(this);
     value.child = link_reverse(value.child);
 }
 
+void JsonNode::append(JsonNode* val, JsonAllocator* allocator) {
+    assert(_type == Type::Array);
+    unindex(this);
+    if (!reserveChild(this, allocator)) return;
+    val->_next = NULL;
+    value.items->items()[value.items->size++] = val;
+}
+
+void JsonNode::append_pair(const char* key, JsonNode* val, JsonAllocator* allocator) {
+    assert(_type == Type::Object);
+    val->name = key;
+    unindex(this);
+    if (!reserveChild(this, allocator)) return;
+    val->_next = NULL;
+    value.items->items()[value.items->size++] = val;
+}
+
+//unlink the member at *link
+static JsonNode* unlinkChild(JsonNode* obj, JsonNode** link) {
+    JsonNode* p = *link;
+    *link = p->_next;
+    p->_next = NULL;
+    --obj->_len;
+    if (obj->_flag == 4) unslot(obj->value.index, p, *link);
+    return p;
+}
+
+static JsonNode* removeItem(ChildArray* array, size_t i) {
+    JsonNode** items = array->items();
+    JsonNode* p = items[i];
+    memmove(items + i, items + i + 1, (array->size - i - 1) * sizeof(JsonNode*));
+    --array->size;
+    //items moved from a list still hold their old links
+    p->_next = NULL;
+    return p;
+}
+
+JsonNode* JsonNode::remove(const char* key) {
+    assert(_type == Type::Object);
+    if (_flag == 5) {
+        ChildArray* array = value.items;
+        for (uint32_t i = 0; i < array->size; ++i) {
+            if (strcmp(array->items()[i]->name, key) == 0) return removeItem(array, i);
+        }
+        return NULL;
+    }
+    if (_flag == 4) {
+        //the table finds it, the walk only looks for the link to it
+        JsonNode* p = (JsonNode*)indexFind(this, key);
+        if (!p) return NULL;
+        JsonNode** link = &value.index->child;
+        while (*link != p) link = &(*link)->_next;
+        return unlinkChild(this, link);
+    }
+    assert(_flag == 0);
+    for (JsonNode** link = &value.child; *link; link = &(*link)->_next) {
+        if (strcmp((*link)->name, key) == 0) return unlinkChild(this, link);
+    }
+    return NULL;
+}
+
+JsonNode* JsonNode::remove_at(size_t i) {
+    assert(_type == Type::Array || _type == Type::Object);
+    if (i >= size()) return NULL;
+    if (_flag == 5) return removeItem(value.items, i);
+    assert(isLinked(this));
+    JsonNode** link = _flag == 4 ? &value.index->child : &value.child;
+    while (i--) link = &(*link)->_next;
+    return unlinkChild(this, link);
+}
+
+void JsonNode::insert_at(size_t i, JsonNode* val, JsonAllocator* allocator) {
+    assert(_type == Type::Array);
+    if (i >= size()) {
+        append(val, allocator);
+        return;
+    }
+    val->_next = NULL;
+    if (_flag == 5) {
+        if (!reserveChild(this, allocator)) return;
+        ChildArray* array = value.items;
+        JsonNode** items = array->items();
+        memmove(items + i + 1, items + i, (array->size - i) * sizeof(JsonNode*));
+        items[i] = val;
+        ++array->size;
+        return;
+    }
+    JsonNode** link = &value.child;
+    while (i--) link = &(*link)->_next;
+    val->_next = *link;
+    *link = val;
+    ++_len;
+}
+
 JsonIterator Value::begin() {
     assert(_type == Type::Array || _type == Type::Object);
     JsonIterator it;
@@ -255,6 +748,15 @@ JsonIterator Value::begin() {
     if (_flag == 0) {
         it.cur = value.child;
     }
+    else if (_flag == 4) {
+        it.cur = value.index->child;
+    }
+    else if (_flag == 5) {
+        it.index = 0;
+    }
+    else if (_flag == 3) {
+        it.pos = this + 1;
+    }
     else {
         it.index = 0;
     }
@@ -265,9 +767,15 @@ JsonIterator Value::end() {
     assert(_type == Type::Array || _type == Type::Object);
     JsonIterator it;
     it.parent = this;
-    if (_flag == 0) {
+    if (isLinked(this)) {
         it.cur = NULL;
     }
+    else if (_flag == 3) {
+        it.pos = this + 1 + value.tape.span;
+    }
+    else if (_flag == 5) {
+        it.index = value.items->size;
+    }
     else {
         it.index = value.imuInfo.sizeOrPos;
     }
@@ -278,26 +786,45 @@ JsonIterator Value::end() {
 // JsonIterator
 /////////////////////////////////////////////////////////////////
 
+//entries of v and its children
+static inline uint32_t tapeSpan(const Value* v) {
+    return v->_flag == 3 ? v->value.tape.span : 0;
+}
+
 void JsonIterator::operator++() {
-    if (parent->_flag == 0) {
+    if (isLinked(parent)) {
         cur = cur->_next;
     }
+    else if (parent->_flag == 3) {
+        //skip the key, then the value with its children
+        Value* val = parent->_type == Type::Object ? pos + 1 : pos;
+        pos = val + 1 + tapeSpan(val);
+    }
     else {
         ++index;
     }
 }
 bool JsonIterator::operator!=(const JsonIterator& x) const {
-    if (parent->_flag == 0) {
+    if (isLinked(parent)) {
         return cur != x.cur;
     }
+    else if (parent->_flag == 3) {
+        return pos != x.pos;
+    }
     else {
         return index != x.index;
     }
 }
 Value* JsonIterator::operator*() const {
-    if (parent->_flag == 0) {
+    if (isLinked(parent)) {
         return cur;
     }
+    else if (parent->_flag == 3) {
+        return parent->_type == Type::Object ? pos + 1 : pos;
+    }
+    else if (parent->_flag == 5) {
+        return parent->value.items->items()[index];
+    }
     else {
         char* buffer = ((char*)parent) - parent->value.imuInfo.selfOffset;
         uint32_t* index = (uint32_t*)(parent + 1);
@@ -316,9 +843,15 @@ Value* JsonIterator::operator->() const {
 }
 const char* JsonIterator::get_name() const {
     if (parent->_type != Type::Object) return NULL;
-    if (parent->_flag == 0) {
+    if (isLinked(parent)) {
         return cur->name;
     }
+    else if (parent->_flag == 3) {
+        return pos->value.str;
+    }
+    else if (parent->_flag == 5) {
+        return parent->value.items->items()[index]->name;
+    }
     else {
         char* buffer = ((char*)parent) - parent->value.imuInfo.selfOffset;
         uint32_t* index = (uint32_t*)(parent + 1);
@@ -336,10 +869,10 @@ static void makesp(std::string& s, int d) {
     while (d--) s += "  ";
 }
 
-static void strEscape(std::string& json, const char* raw) {
+static void strEscape(std::string& json, const char* raw, size_t len) {
     const char* c = raw;
     if (!c) return;
-    while (*c) {
+    for (const char* end = raw + len; c != end; ++c) {
         switch (*c) {
         case '\b': json += ('\\'); json += ('b'); break;
         case '\f': json += ('\\'); json += ('f'); break;
@@ -350,14 +883,16 @@ static void strEscape(std::string& json, const char* raw) {
         case '"':  json += ('\\'); json += ('"'); break;
         default: json += *c;
         }
-        ++c;
     }
 }
 
-static bool strNeedEscape(const char* raw) {
+static void strEscape(std::string& json, const char* raw) {
+    if (raw) strEscape(json, raw, strlen(raw));
+}
+static bool strNeedEscape(const char* raw, size_t len) {
     const char* c = raw;
     if (!c) return false;
-    while (true) {
+    for (const char* end = raw + len; c != end; ++c) {
         switch (*c)
         {
         case '"':
@@ -376,112 +911,424 @@ static bool strNeedEscape(const char* raw) {
         default:
             break;
         }
-        ++c;
     }
     return false;
 }
 
+namespace {
+struct JsonFrame {
+    Value* node;
+    JsonIterator it;
+    JsonIterator end;
+    int level;
+    bool isFirst;
+    //HIML: writing the _children list of node
+    bool inChildren;
+};
+}
+
 void Value::to_json(std::string& json, bool isHiml, int level) {
-    Type ttype = type();
-    switch (ttype) {
+    //iterative: deep documents can not overflow the call stack
+    FrameStack<JsonFrame> stack;
+    Value* v = this;
+    JsonFrame* top;
+
+value:
+    switch (v->type()) {
     case Type::String: {
-        const char* str = as_str();
-        if (!isHiml || strNeedEscape(str)) {
+        const char* str = v->as_str();
+        size_t len = v->str_len();
+        if (!isHiml || strNeedEscape(str, len)) {
             json += ("\"");
-            strEscape(json, str);
+            strEscape(json, str, len);
             json += ("\"");
         }
         else {
-            json += str;
+            json.append(str, len);
         }
         break;
     }
     case Type::Integer: {
+        if (v->_flag == 2) {
+            json.append(v->value.str, v->_len);
+            break;
+        }
         char buf[256];
-        snprintf(buf, 256, "%lld", value.i);
+        snprintf(buf, 256, "%lld", v->value.i);
         json += buf;
         break;
     }
     case Type::Float: {
+        if (v->_flag == 2) {
+            json.append(v->value.str, v->_len);
+            break;
+        }
         char buf[256];
-        snprintf(buf, 256, "%.16g", value.d);
+        snprintf(buf, 256, "%.16g", v->value.d);
         json += buf;
         break;
     }
     case Type::Boolean:
-        json += value.b ? "true" : "false";
+        json += v->value.b ? "true" : "false";
         break;
     case Type::Null:
         json += "null";
         break;
-    case Type::Array: {
+    case Type::Array:
         json += isHiml ? "{\n" : "[\n";
-        for (auto p = begin(); p != end(); ++p) {
-            if (p != begin()) json += ",\n";
-            makesp(json, level + 1);
-            p->to_json(json, isHiml, level + 1);
-        }
-        json += '\n';
-        makesp(json, level);
-        json += isHiml ? "}" : "]";
-        break;
-    }
+        goto open;
     case Type::Object: {
         if (isHiml) {
-            Value* typeName = objectType();
+            Value* typeName = v->objectType();
             if (typeName) {
                 typeName->to_json(json, isHiml, level);
                 json += " ";
             }
         }
         json += ("{\n");
-        bool isFirst = true;
-        for (auto p = begin(); p != end(); ++p) {
-            const char* key = p.get_name();
-            if (isHiml) {
+        goto open;
+    }
+    default:
+        break;
+    }
+    goto next;
+
+open:
+    top = stack.push();
+    top->node = v;
+    top->it = v->begin();
+    top->end = v->end();
+    top->level = level;
+    top->isFirst = true;
+    top->inChildren = false;
+
+next:
+    while (!stack.empty()) {
+        top = stack.back();
+        bool isObject = top->node->type() == Type::Object && !top->inChildren;
+        while (top->it != top->end) {
+            v = *top->it;
+            const char* key = top->it.get_name();
+            ++top->it;
+            if (isObject && isHiml) {
                 if (strcmp(key, "_children") == 0 || strcmp(key, "_type") == 0) {
                     continue;
                 }
             }
 
-            if (!isFirst) {
-                json += isHiml ? "\n": ",\n";
+            if (!top->isFirst) {
+                json += (isHiml && isObject) || top->inChildren ? "\n" : ",\n";
             }
-            makesp(json, level + 1);
+            top->isFirst = false;
+            makesp(json, top->level + 1);
 
-            if (isHiml) {
-                strEscape(json, key);
-                json += " = ";
-            }
-            else {
-                json += ("\"");
-                strEscape(json, key);
-                json += ("\"");
-                json += ": ";
+            if (isObject) {
+                if (isHiml) {
+                    strEscape(json, key);
+                    json += " = ";
+                }
+                else {
+                    json += ("\"");
+                    strEscape(json, key);
+                    json += ("\"");
+                    json += ": ";
+                }
             }
+            level = top->level + 1;
+            goto value;
+        }
 
-            p->to_json(json, isHiml, level + 1);
-            isFirst = false;
+        //HIML writes the children after the pairs
+        if (isObject && isHiml && top->node->children()) {
+            Value* c = top->node->children();
+            json += '\n';
+            top->inChildren = true;
+            top->isFirst = true;
+            top->it = c->begin();
+            top->end = c->end();
+            continue;
         }
         json += '\n';
+        makesp(json, top->level);
+        json += top->node->type() == Type::Object || isHiml ? "}" : "]";
+        stack.pop();
+    }
+}
 
-        if (isHiml) {
-            Value* c = children();
-            if (c) {
-                for (auto p = c->begin(); p != c->end(); ++p) {
-                    if (p != c->begin()) json += "\n";
-                    makesp(json, level + 1);
-                    p->to_json(json, isHiml, level + 1);
-                }
-                json += '\n';
-            }
-        }
-        makesp(json, level);
-        json += ("}");
+/////////////////////////////////////////////////////////////////
+// Summary
+/////////////////////////////////////////////////////////////////
+
+size_t ParseSummary::total() {
+    size_t n = 0;
+    for (int i = 0; i < 7; ++i) n += nodes[i];
+    return n;
+}
+
+namespace {
+struct SummaryFrame {
+    JsonIterator it;
+    JsonIterator end;
+};
+}
+
+ParseSummary summarize(Value* root) {
+    ParseSummary sum;
+    memset(&sum, 0, sizeof(sum));
+    if (!root) return sum;
+    FrameStack<SummaryFrame> stack;
+    Value* v = root;
+
+value:
+    ++sum.nodes[(int)v->type()];
+    switch (v->type()) {
+    case Type::String:
+        sum.stringBytes += v->str_len();
+        break;
+    case Type::Array:
+    case Type::Object: {
+        SummaryFrame* frame = stack.push();
+        frame->it = v->begin();
+        frame->end = v->end();
+        if (stack.size() > sum.maxDepth) sum.maxDepth = stack.size();
         break;
     }
     default:
         break;
     }
+
+    while (!stack.empty()) {
+        SummaryFrame* top = stack.back();
+        if (!(top->it != top->end)) {
+            stack.pop();
+            continue;
+        }
+        v = *top->it;
+        const char* name = top->it.get_name();
+        if (name) sum.keyBytes += strlen(name);
+        ++top->it;
+        goto value;
+    }
+    return sum;
+}
+
+namespace {
+struct IndexFrame {
+    JsonIterator it;
+    JsonIterator end;
+};
+}
+
+void index_keys(Value* root, JsonAllocator* allocator, size_t minKeys) {
+    if (!root) return;
+    FrameStack<IndexFrame> stack;
+    Value* v = root;
+
+value:
+    if (v->type() == Type::Array || v->type() == Type::Object) {
+        if (v->type() == Type::Object && v->_flag == 0) {
+            size_t n = v->size();
+            if (n >= minKeys) indexObject(v, n, allocator);
+        }
+        IndexFrame* frame = stack.push();
+        frame->it = v->begin();
+        frame->end = v->end();
+    }
+
+    while (!stack.empty()) {
+        IndexFrame* top = stack.back();
+        if (!(top->it != top->end)) {
+            stack.pop();
+            continue;
+        }
+        v = *top->it;
+        ++top->it;
+        goto value;
+    }
+}
+
+/////////////////////////////////////////////////////////////////
+// Clone
+/////////////////////////////////////////////////////////////////
+
+namespace {
+struct CloneFrame {
+    JsonIterator it;
+    JsonIterator end;
+    BuildFrame build;
+};
+
+/**
+* Strings already copied by one clone, equal ones share the copy.
+*/
+class StringDedup {
+    struct Entry {
+        const char* str;
+        uint32_t hash;
+        uint32_t len;
+    };
+    std::vector<Entry> slots;
+    size_t count;
+
+    void grow() {
+        std::vector<Entry> old;
+        old.swap(slots);
+        Entry empty = { NULL, 0, 0 };
+        slots.resize(old.empty() ? 256 : old.size() * 2, empty);
+        size_t mask = slots.size() - 1;
+        for (const Entry& e : old) {
+            if (!e.str) continue;
+            size_t i = e.hash & mask;
+            while (slots[i].str) i = (i + 1) & mask;
+            slots[i] = e;
+        }
+    }
+public:
+    StringDedup() : count(0) {}
+
+    const char* copy(const char* s, size_t len, JsonAllocator* allocator) {
+        if ((count + 1) * 2 > slots.size()) grow();
+        uint32_t h = key_hash(s, len);
+        size_t mask = slots.size() - 1;
+        size_t i = h & mask;
+        for (; slots[i].str; i = (i + 1) & mask) {
+            const Entry& e = slots[i];
+            if (e.hash == h && e.len == len && memcmp(e.str, s, len) == 0) return e.str;
+        }
+        char* str = (char*)allocator->allocate_raw(len + 1);
+        memcpy(str, s, len);
+        str[len] = 0;
+        Entry e = { str, h, (uint32_t)len };
+        slots[i] = e;
+        ++count;
+        return str;
+    }
+};
+}
+
+static const char* cloneStr(const char* s, size_t len, JsonAllocator* allocator, StringDedup* dedup) {
+    if (!s) return NULL;
+    if (dedup) return dedup->copy(s, len, allocator);
+    char* str = (char*)allocator->allocate_raw(len + 1);
+    memcpy(str, s, len);
+    str[len] = 0;
+    return str;
+}
+
+static const char* cloneStr(const char* s, JsonAllocator* allocator, StringDedup* dedup) {
+    if (!s) return NULL;
+    return cloneStr(s, strlen(s), allocator, dedup);
+}
+
+JsonNode* Value::clone_into(JsonAllocator* allocator, bool dedupStrings) {
+    //iterative, in traversal order: each node is followed by its key and string
+    StringDedup dedup;
+    StringDedup* strings = dedupStrings ? &dedup : NULL;
+    FrameStack<CloneFrame> stack;
+    Value* v = this;
+    const char* name = NULL;
+    JsonNode* root = NULL;
+
+value:
+    {
+        JsonNode* node = allocator->allocNode(v->type());
+        if (!stack.empty()) {
+            CloneFrame* top = stack.back();
+            if (top->build.node->_type == Type::Object) node->name = cloneStr(name, allocator, strings);
+            top->build.append(node);
+        }
+        else {
+            root = node;
+        }
+
+        switch (v->type()) {
+        case Type::String:
+            node->value.str = (char*)cloneStr(v->as_str(), v->str_len(), allocator, strings);
+            break;
+        case Type::Integer:
+        case Type::Float:
+            if (v->_flag == 2) {
+                char* text = (char*)allocator->allocate_raw(v->_len);
+                memcpy(text, v->value.str, v->_len);
+                node->set_raw_num(text, v->_len, v->_type == Type::Float);
+                break;
+            }
+            node->value = v->value;
+            break;
+        case Type::Boolean:
+            node->value.b = v->value.b;
+            break;
+        case Type::Array:
+        case Type::Object: {
+            node->value.child = NULL;
+            CloneFrame* frame = stack.push();
+            frame->it = v->begin();
+            frame->end = v->end();
+            frame->build.node = node;
+            frame->build.tail = NULL;
+            break;
+        }
+        default:
+            break;
+        }
+    }
+
+    while (!stack.empty()) {
+        CloneFrame* top = stack.back();
+        if (!(top->it != top->end)) {
+            stack.pop();
+            continue;
+        }
+        v = *top->it;
+        name = top->it.get_name();
+        ++top->it;
+        goto value;
+    }
+    return root;
+}
+
+//bytes clone_into takes without dedup, allocations are 8 byte aligned
+static size_t cloneSize(Value* root) {
+    size_t bytes = 0;
+    FrameStack<SummaryFrame> stack;
+    Value* v = root;
+
+value:
+    bytes += sizeof(JsonNode);
+    if (v->type() == Type::String) {
+        bytes += (v->str_len() + 1 + 7) & ~7;
+    }
+    else if (v->_flag == 2) {
+        bytes += (v->_len + 7) & ~7;
+    }
+    else if (v->type() == Type::Array || v->type() == Type::Object) {
+        SummaryFrame* frame = stack.push();
+        frame->it = v->begin();
+        frame->end = v->end();
+    }
+
+    while (!stack.empty()) {
+        SummaryFrame* top = stack.back();
+        if (!(top->it != top->end)) {
+            stack.pop();
+            continue;
+        }
+        v = *top->it;
+        const char* name = top->it.get_name();
+        if (name) bytes += (strlen(name) + 1 + 7) & ~7;
+        ++top->it;
+        goto value;
+    }
+    return bytes;
+}
+
+JsonNode* JsonAllocator::compact(Value* root, bool dedupStrings) {
+    if (!root) return NULL;
+    //one block that fits the whole copy
+    JsonAllocator fresh(sizeof(Block) + cloneSize(root));
+    fresh.source = source;
+    JsonNode* copy = root->clone_into(&fresh, dedupStrings);
+    swap(fresh);
+    return copy;
 }
 }
\ No newline at end of file
@@ -14,10 +14,19 @@
 #include <string.h>
 
 
+#ifndef JSONC_INDEX_MIN_KEYS
+//objects with fewer members are searched linearly
+#define JSONC_INDEX_MIN_KEYS 16
+#endif
+
 namespace jsonc {
 
     class Value;
+    class MemorySource;
+    class JsonAllocator;
     struct JsonNode;
+    struct KeyIndex;
+    struct ChildArray;
     JsonNode* link_reverse(JsonNode* head);
     
     enum class Type : uint8_t {
@@ -37,12 +46,25 @@ namespace jsonc {
         uint32_t sizeOrPos;
     };
 
+    /**
+    * Array/Object of a tape (see JsonParser::parse_tape). The entries of the
+    * children follow the container, object members as a key entry then the value.
+    */
+    struct TapeInfo {
+        //entries after this one that belong to it
+        uint32_t span;
+        //Array/Object size
+        uint32_t size;
+    };
+
     struct JsonIterator {
         Value* parent;
         union
         {
             int index;
             JsonNode* cur;
+            //tape entry, the key of object members
+            Value* pos;
         };
         void operator++();
         bool operator!=(const JsonIterator& x) const;
@@ -61,25 +83,47 @@ namespace jsonc {
             int64_t i;
             double d;
             bool b;
-            char *str; //String, StringRef
+            char *str; //String, StringRef, not terminated when _flag == 6
             ImuInfo imuInfo; //_flag == 1
+            TapeInfo tape; //_flag == 3
+            KeyIndex* index; //Object, _flag == 4, see index_keys()
+            ChildArray* items; //Array/Object, _flag == 5, see JsonNode::append
+            //raw number text when _flag == 2
             JsonNode* child; //Array, Object
         } value;
         Type _type;
         uint8_t _flag;
+        //raw number length, _flag == 2
+        //length of a string referenced in the input, _flag == 6
+        //member count of Array/Object, _flag == 0 or 4
+        //slots of the key table of v3 objects, _flag == 1
+        uint32_t _len;
  
     public:
-        Value(Type t = Type::Null) : _type(t), _flag(0) { value.i = 0; }
+        Value(Type t = Type::Null) : _type(t), _flag(0), _len(0) { value.i = 0; }
         
         void set_int(const int64_t other);
         void set_float(const double other);
         void set_bool(const bool other);
         void set_str(char *str);
+        /** keep the number text, converted on access and written back unchanged */
+        void set_raw_num(const char* str, uint32_t len, bool isFloat);
         
         Type type() { return _type; }
         void set_type(Type t) { _type = t; }
         
+        /**
+        * Text of a String. A string referenced in the input (see
+        * JsonParser::stringRefs) is not NUL terminated, its length is str_len().
+        */
         const char *as_str(const char *defVal = "");
+        /**
+        * Same as as_str, but a string referenced in the input is copied into
+        * allocator and terminated on the first call.
+        */
+        const char *as_str(JsonAllocator* allocator);
+        /** bytes of a String without the terminator, 0 otherwise */
+        size_t str_len();
         int64_t as_int();
         double as_float();
         bool as_bool();
@@ -88,8 +132,22 @@ namespace jsonc {
                 (_type == Type::String || strcmp("null", as_str()) == 0);
         }
         
+        /** children of an Array/Object, 0 otherwise */
         size_t size();
+        /** child i of an Array/Object, NULL when out of range. O(1) for v3 and append() containers */
+        Value* at(size_t i);
         Value* get(const char* name);
+        /**
+        * Same as get, but an object of JSONC_INDEX_MIN_KEYS members or more
+        * gets a hash index in allocator on the first call.
+        */
+        Value* get(const char* name, JsonAllocator* allocator);
+        /**
+        * Lookup by a key from the KeyTable the tree was interned with, see
+        * jintern.hpp. Keys are compared by pointer, members added with
+        * other strings are not found. v3 objects use get().
+        */
+        Value* get_interned(const char* key);
 
         int64_t get_int(const char* name, int64_t defval = 0);
         double get_float(const char* name, double defval = 0);
@@ -103,6 +161,14 @@ namespace jsonc {
         Value* children() { return get("_children"); }
         Value* objectType() { return get("_type"); }
         
+        /**
+        * Deep copy into allocator as mutable JsonNodes, in traversal order.
+        * Strings, keys and raw numbers are copied, so the source buffer and
+        * allocator can go. dedupStrings: equal strings share one copy.
+        * Works for every representation, v3 and tapes included.
+        */
+        JsonNode* clone_into(JsonAllocator* allocator, bool dedupStrings = false);
+
         /**
         dump to json
         */
@@ -124,29 +190,135 @@ namespace jsonc {
 
         /** slow than insert */
         void _append(JsonNode* val);
+
+        /**
+        * Append in order in O(1). The children move to an array in allocator,
+        * which doubles when full, so at() is O(1) too.
+        * insert, insert_pair and reverse turn the array back into a list.
+        */
+        void append(JsonNode* val, JsonAllocator* allocator);
+        void append_pair(const char* key, JsonNode* val, JsonAllocator* allocator);
+
+        /** unlink the first member named key, NULL if there is none. The key index is kept */
+        JsonNode* remove(const char* key);
+        /** unlink child i of an Array/Object, NULL when out of range */
+        JsonNode* remove_at(size_t i);
+        /** insert before child i of an Array, i >= size() appends as append() does */
+        void insert_at(size_t i, JsonNode* val, JsonAllocator* allocator);
     };
     
+    /**
+    * Memory of a JsonAllocator, see get_stats().
+    */
+    struct AllocatorStats {
+        /** bytes asked for since the last reset */
+        size_t requested;
+        /** bytes of the blocks in use */
+        size_t reserved;
+        /** room left in the current block */
+        size_t available;
+        /** reserved minus requested and available: headers, alignment and the unused tails of full blocks */
+        size_t fragmentation;
+        /** bytes kept by reset() for reuse */
+        size_t retained;
+        size_t blocks;
+        /** allocations too big for a block, each got its own */
+        size_t largeAllocs;
+        /** most bytes reserved at once since construction */
+        size_t highWater;
+    };
+
     class JsonAllocator {
         struct Block {
             Block* next;
             size_t used;
+            size_t size;
+            //NULL: malloc
+            MemorySource* source;
+            //memory of the caller, never freed
+            bool external;
         } *head;
+        //blocks kept by reset() for reuse
+        Block* spare;
+        //size of the next new block, doubles up to JSON_MAX_BLOCK_SIZE
+        size_t blockSize;
+        MemorySource* source;
+        //counters for get_stats
+        size_t requested;
+        size_t reserved;
+        size_t largeAllocs;
+        size_t highWater;
 
+        void* newBlock(size_t size);
     public:
         void swap(JsonAllocator& other);
-        JsonAllocator() : head(nullptr) {};
+        /** take over all blocks of other, values allocated there stay valid */
+        void merge(JsonAllocator& other);
+        /** blockSize: size of the first block, later blocks grow geometrically */
+        JsonAllocator(size_t blockSize = 4096) : head(nullptr), spare(nullptr), blockSize(blockSize), source(nullptr),
+            requested(0), reserved(0), largeAllocs(0), highWater(0) {};
+        /**
+        * Serve allocations from buffer first (a stack array or a slab), heap
+        * blocks are only added when it is full. buffer must outlive the allocator.
+        */
+        JsonAllocator(void* buffer, size_t size, size_t blockSize = 4096);
         ~JsonAllocator();
+
+        /** zero filled memory */
         void* allocate(size_t size);
 
+        /** uninitialized memory, the caller writes every byte it reads */
+        inline void* allocate_raw(size_t size) {
+            requested += size;
+            size = (size + 7) & ~7;
+            if (head && head->used + size <= head->size) {
+                char* p = (char*)head + head->used;
+                head->used += size;
+                return p;
+            }
+            return newBlock(size);
+        }
+
+        /**
+        * Take new blocks from source instead of malloc, see jmemory.hpp.
+        * Blocks already allocated are returned to where they came from.
+        */
+        void set_source(MemorySource* source) { this->source = source; }
+
+        /**
+        * Free everything allocated so far but keep the blocks, later
+        * allocations reuse them without calling malloc.
+        */
+        void reset();
+
+        /** free blocks kept by reset() until at most keep bytes are left */
+        void trim(size_t keep = 0);
+
+        /** walks the block lists, not for hot paths */
+        AllocatorStats get_stats();
+
+        /**
+        * Replace the memory of this allocator with a copy of the tree at root,
+        * packed in one block (see Value::clone_into). Returns the new root,
+        * every other value of this allocator becomes invalid.
+        */
+        JsonNode* compact(Value* root, bool dedupStrings = false);
+
         inline JsonNode* allocNode(Type type) {
-            JsonNode* v = (JsonNode*)allocate(sizeof(JsonNode));
+            JsonNode* v = (JsonNode*)allocate_raw(sizeof(JsonNode));
+            v->value.i = 0;
             v->_type = type;
+            v->_flag = 0;
+            v->_len = 0;
+            v->_next = NULL;
+            v->name = NULL;
             return v;
         }
 
         inline char* strdup(const char* s) {
-            char* str = (char*)allocate(strlen(s) + 1);
-            strcpy(str, s);
+            size_t n = strlen(s) + 1;
+            char* str = (char*)allocate_raw(n);
+            memcpy(str, s, n);
             return str;
         }
 
@@ -174,6 +346,103 @@ namespace jsonc {
             return value;
         }
     };
+
+    /**
+    * An open Array/Object while a tree is built in document order.
+    */
+    struct BuildFrame {
+        JsonNode* node;
+        JsonNode* tail;
+
+        void append(JsonNode* val) {
+            if (tail) tail->_next = val;
+            else node->value.child = val;
+            tail = val;
+            ++node->_len;
+        }
+    };
+
+    /**
+    * Explicit stack for the iterative engines. Frames come from the allocator,
+    * one per nesting level, and are reused after a pop. T must be POD.
+    */
+    template<typename T>
+    class FrameStack {
+        struct Frame {
+            T data;
+            Frame* up;
+            Frame* down;
+        };
+        JsonAllocator own;
+        JsonAllocator* allocator;
+        Frame* bottom;
+        Frame* top;
+        size_t depth;
+    public:
+        /** allocator NULL: use a private one */
+        FrameStack(JsonAllocator* allocator = NULL) : bottom(NULL), top(NULL), depth(0) {
+            this->allocator = allocator ? allocator : &own;
+        }
+
+        T* push() {
+            Frame* f = top ? top->down : bottom;
+            if (!f) {
+                f = (Frame*)allocator->allocate_raw(sizeof(Frame));
+                f->up = top;
+                f->down = NULL;
+                if (top) top->down = f;
+                else bottom = f;
+            }
+            top = f;
+            ++depth;
+            return &f->data;
+        }
+        void pop() {
+            top = top->up;
+            --depth;
+        }
+        T* back() { return &top->data; }
+        bool empty() { return top == NULL; }
+        size_t size() { return depth; }
+    private:
+        FrameStack(const FrameStack&);
+        FrameStack& operator=(const FrameStack&);
+    };
+
+    /**
+    * Shape of a tree, see summarize().
+    */
+    struct ParseSummary {
+        /** nodes of each Type, indexed by (int)Type */
+        size_t nodes[7];
+        /** bytes of string values, without terminators */
+        size_t stringBytes;
+        /** bytes of object keys */
+        size_t keyBytes;
+        /** deepest container nesting, 0 for a scalar root */
+        size_t maxDepth;
+
+        size_t count(Type t) { return nodes[(int)t]; }
+        size_t total();
+    };
+
+    /**
+    * Count the nodes of root, an iterative walk.
+    */
+    ParseSummary summarize(Value* root);
+
+    /**
+    * Give every object of root with at least minKeys members a hash index,
+    * allocated in allocator, so get() on it is a hash lookup. insert_pair
+    * updates the index while the table is at most half full and drops it
+    * after that, remove keeps it, append_pair and reverse drop it.
+    * get(name, allocator) indexes the object again.
+    */
+    void index_keys(Value* root, JsonAllocator* allocator, size_t minKeys = JSONC_INDEX_MIN_KEYS);
+
+    /** hash of object keys, v3 buffers store tables built with it */
+    uint32_t key_hash(const char* key);
+    uint32_t key_hash(const char* key, size_t len);
 }//ns
 
 namespace jc = jsonc;
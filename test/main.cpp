@@ -9,8 +9,31 @@
 #include "jcompress.hpp"
 #include "jparser.hpp"
 #include "HimlParser.hpp"
+#include "jmapped.hpp"
+#include "jnumber.hpp"
+#include "jsax.hpp"
+#include "jlazy.hpp"
+#include "jpatch.hpp"
+#include "jlines.hpp"
+#include "jproject.hpp"
+#include "jpool.hpp"
+#include "jmemory.hpp"
+#include "jintern.hpp"
+#include "jvalidate.hpp"
+#include "jsimd.hpp"
 #include <time.h>
+#include <errno.h>
+#include <stdlib.h>
 #include <fstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
 using namespace jsonc;
 
@@ -22,10 +45,12 @@ using namespace jsonc;
 void testParse() {
     const char* file = TEST_FILE;
 
-    std::ifstream in(file);
-    std::string str = "";
-    std::string tmp;
-    while (getline(in, tmp)) str += tmp;
+    MappedDocument doc;
+    if (!doc.open(file)) {
+        printf("%s\n", doc.get_error());
+        return;
+    }
+    std::string str(doc.get_data(), doc.get_size());
     
     clock_t t0 = clock();
     for (int i=0; i< LOOP_TIMES; ++i) {
@@ -61,33 +86,25 @@ void testParse() {
 /////////////////////////////////////////////////////////////////
 #ifndef JC_NO_COMPRESS
 
-bool packJson(std::string& jsonstr, std::ostream& out) {
-    JsonAllocator allocator;
-    JsonParser parser(&allocator);
-    Value* v = parser.parse((char*)jsonstr.c_str());
+bool packJson(Value* v, std::ostream& out) {
     JCWriter c;
     c.write(v, out);
     return true;
 }
 
 void writeTest() {
-    std::ifstream in(TEST_FILE);
-    std::string str = "";
-    std::string tmp;
-    while (getline(in, tmp)) str += tmp;
+    MappedDocument doc;
+    if (!doc.open(TEST_FILE)) return;
 
     std::ofstream out("./data_out.jc", std::ofstream::binary | std::ofstream::out);
-    packJson(str, out);
+    packJson(doc.get_root(), out);
 }
 
 void readTest() {
-    std::ifstream inStream("./data_out.jc", std::ifstream::binary | std::ifstream::in);
-    inStream.seekg(0, std::ios::end);
-    long length = inStream.tellg();
-    inStream.seekg(0, std::ios::beg);
-
-    char* buffer = (char*)malloc(length);
-    inStream.read(buffer, length);
+    MappedDocument doc;
+    if (!doc.open("./data_out.jc")) return;
+    char* buffer = (char*)doc.get_data();
+    int length = (int)doc.get_size();
 
     clock_t t0 = clock();
     for (int i = 0; i < LOOP_TIMES; ++i) {
@@ -108,7 +125,6 @@ void readTest() {
     printf("%s\n", str.c_str());
     //value0.free();
 #endif
-    free(buffer);
 }
 #endif
 /////////////////////////////////////////////////////////////////
@@ -116,10 +132,7 @@ void readTest() {
 /////////////////////////////////////////////////////////////////
 #ifndef NO_JC_ENCODER
 
-bool packJson2(std::string& jsonstr, std::ostream& out) {
-    JsonAllocator allocator;
-    JsonParser parser(&allocator);
-    Value* v = parser.parse((char*)jsonstr.c_str());
+bool packJson2(Value* v, std::ostream& out) {
     JEncoder encoder;
     auto buffer = encoder.encode(v);
     out.write(buffer.data(), buffer.size());
@@ -128,24 +141,18 @@ bool packJson2(std::string& jsonstr, std::ostream& out) {
 }
 
 void writeTest2() {
-    std::ifstream in(TEST_FILE);
-    std::string str = "";
-    std::string tmp;
-    while (getline(in, tmp)) str += tmp;
-    
+    MappedDocument doc;
+    if (!doc.open(TEST_FILE)) return;
+
     std::ofstream out("./data_out.jc2", std::ofstream::binary | std::ofstream::out);
-    packJson2(str, out);
+    packJson2(doc.get_root(), out);
 }
 
 void readTest2() {
-    std::ifstream inStream("./data_out.jc2", std::ifstream::binary|std::ifstream::in);
-
-    inStream.seekg(0, std::ios::end);
-    long length = inStream.tellg();
-    inStream.seekg(0, std::ios::beg);
-    
-    char *buffer = (char*)malloc(length);
-    inStream.read(buffer, length);
+    MappedDocument doc;
+    if (!doc.open("./data_out.jc2", MapAccess::Random)) return;
+    char* buffer = (char*)doc.get_data();
+    int length = (int)doc.get_size();
 
     clock_t t0 = clock();
     Value *value0;
@@ -160,7 +167,6 @@ void readTest2() {
     value0->to_json(str);
     puts(str.c_str());
 #endif
-    free(buffer);
 }
 #endif
 /////////////////////////////////////////////////////////////////
@@ -168,51 +174,32 @@ void readTest2() {
 /////////////////////////////////////////////////////////////////
 
 void convert(const char *from, const char *to, int version) {
-    std::ifstream in(from, std::ifstream::binary | std::ifstream::in);
-    std::string str = "";
-    std::string tmp;
-    while (getline(in, tmp)) str += tmp;
-    
-    std::ofstream out(to);
+    MappedDocument doc;
+    Value* v = doc.open(from);
+    if (!v) {
+        printf("%s\n", doc.get_error());
+        return;
+    }
+
+    std::ofstream out(to, std::ofstream::binary | std::ofstream::out);
     if (version == 2) {
-        packJson2(str, out);
+        packJson2(v, out);
     }
     else {
-        packJson(str, out);
+        packJson(v, out);
     }
 }
 
 void dump(const char *from) {
-    std::ifstream inStream(from, std::ifstream::binary | std::ifstream::in);
-    inStream.seekg(0, std::ios::end);
-    long length = inStream.tellg();
-    inStream.seekg(0, std::ios::beg);
-
-    char* buffer = (char*)malloc(length);
-    inStream.read(buffer, length);
-
-    int32_t *version = (int32_t*)(buffer + 4);
-
-    if (*version == 2) {
-        printf("unsupport version:%d\n", *version);
-    }
-    else if (*version == 3) {
-        Value* json = JEncoder::decode(buffer, length);
-        std::string str;
-        json->to_json(str);
-        puts(str.c_str());
-    }
-    else if (*version == 1) {
-        JsonAllocator allocator;
-        JCReader r(buffer, length, &allocator);
-        Value* value = r.read();
-        std::string str;
-        value->to_json(str);
-        puts(str.c_str());
-        //value.free();
+    MappedDocument doc;
+    Value* json = doc.open(from);
+    if (!json) {
+        printf("%s\n", doc.get_error());
+        return;
     }
-
-    free(buffer);
+    std::string str;
+    json->to_json(str);
+    puts(str.c_str());
 }
 
 /////////////////////////////////////////////////////////////////
@@ -245,6 +232,1520 @@ void testHiml() {
     }
 }
 
+/////////////////////////////////////////////////////////////////
+// Checks
+/////////////////////////////////////////////////////////////////
+
+static int checkFailed = 0;
+
+static void check(bool ok, const char* what, const std::string& input) {
+    if (ok) return;
+    ++checkFailed;
+    printf("check failed: %s: %.80s\n", what, input.c_str());
+}
+
+static std::string toJson(Value* v) {
+    std::string str;
+    if (v) v->to_json(str);
+    else str = "<error>";
+    return str;
+}
+
+static const char* checkDocs[] = {
+    "{\"a\":1,\"b\":[true,false,null],\"c\":{\"d\":\"e\\n\\u00e9\\ud83d\\ude00\"}}",
+    "[]",
+    "{}",
+    "[[[]],{},[{}]]",
+    "\"str\"",
+    "123",
+    "-0.5e-3",
+    "null",
+    " { \"x\" : [ 1 , -2 , 3.25 , 1e21 , 9223372036854775807 , -9223372036854775808 ] } ",
+    "[\"quote\\\"back\\\\slash\\/\", \"\\b\\f\\r\\t\", \"\"]",
+};
+
+static std::vector<std::string> checkInputs() {
+    std::vector<std::string> docs(checkDocs, checkDocs + sizeof(checkDocs) / sizeof(checkDocs[0]));
+    //enough members for a key index
+    std::string obj = "{";
+    for (int i = 0; i < 40; ++i) {
+        if (i) obj += ",";
+        obj += "\"key" + std::to_string(i) + "\":" + std::to_string(i * 7);
+    }
+    obj += "}";
+    docs.push_back(obj);
+    //a root array parse_parallel splits
+    std::string big = "[";
+    while (big.size() < 3 * 1024 * 1024) {
+        big += "{\"id\":12345,\"name\":\"rec,ord]\",\"tags\":[\"a\",\"b\"],\"v\":1.5},";
+    }
+    big.back() = ']';
+    docs.push_back(big);
+    return docs;
+}
+
+void checkParsers() {
+    std::vector<std::string> docs = checkInputs();
+    for (const std::string& doc : docs) {
+        JsonAllocator allocator;
+        JsonParser parser(&allocator);
+        std::string copy = doc;
+        std::string ref = toJson(parser.parse(&copy[0]));
+        check(!parser.get_error()[0], "parse", doc);
+
+        copy = doc;
+        check(toJson(parser.parse_indexed(&copy[0], copy.size())) == ref, "parse_indexed", doc);
+
+        //chunks split tokens and escapes anywhere
+        size_t chunks[] = { 1, 7, 4096 };
+        for (size_t n : chunks) {
+            if (n == 1 && doc.size() > 65536) continue;
+            bool ok = true;
+            for (size_t i = 0; i < doc.size() && ok; i += n) {
+                ok = parser.feed(doc.data() + i, doc.size() - i < n ? doc.size() - i : n);
+            }
+            Value* v = parser.finish();
+            check(ok && toJson(v) == ref, "feed/finish", doc);
+        }
+
+        LazyDocument lazy(&allocator);
+        check(toJson(lazy.parse(doc.data(), doc.size()).materialize()) == ref, "LazyValue::materialize", doc);
+
+        //no terminator, nothing after the last byte
+        std::vector<char> exact(doc.begin(), doc.end());
+        check(toJson(parser.parse(exact.data(), exact.size())) == ref, "parse(data, len)", doc);
+        parser.stringRefs = true;
+        Value* refs = parser.parse(exact.data(), exact.size());
+        check(toJson(refs) == ref, "stringRefs", doc);
+        check(toJson(refs->clone_into(&allocator)) == ref, "stringRefs clone_into", doc);
+        parser.stringRefs = false;
+
+        SaxParser<DomHandler> sax;
+        DomHandler dom(&allocator);
+        check(sax.parse(doc.data(), doc.size(), dom) && toJson(dom.get_root()) == ref, "SaxParser", doc);
+
+        copy = doc;
+        check(toJson(parser.parse_parallel(&copy[0], copy.size(), 4)) == ref, "parse_parallel", doc);
+
+        copy = doc;
+        check(toJson(parser.parse_tape(&copy[0])) == ref, "parse_tape", doc);
+    }
+}
+
+static const char* badDocs[] = {
+    "{\"a\":1,",
+    "{\"a\"",
+    "{\"a\":1",
+    "{\"a\" 1}",
+    "{\"a\":}",
+    "{1:2}",
+    "[1,",
+    "[1 2]",
+    "[\"a\\uZZZZ\"]",
+    "[\"a\\u12",
+    "\"abc",
+    "tru",
+    "-",
+    "",
+};
+
+//strings referenced in a read-only buffer, not terminated there
+void checkStringRefs() {
+    std::string doc = "[\"abc\",\"a\\nb\",{\"k\":\"v\"},\"abc\"]";
+    std::vector<char> exact(doc.begin(), doc.end());
+    JsonAllocator allocator;
+    JsonParser parser(&allocator);
+    parser.stringRefs = true;
+    Value* v = parser.parse(exact.data(), exact.size());
+    check(v && v->size() == 4, "stringRefs parse", doc);
+    if (!v) return;
+    Value* s = v->at(0);
+    check(s->str_len() == 3 && s->as_str() == exact.data() + 2, "stringRefs reference", doc);
+    check(strcmp(v->at(1)->as_str(), "a\nb") == 0, "stringRefs escaped copy", doc);
+    check(v->at(2)->get("k")->str_len() == 1, "stringRefs member", doc);
+
+    std::string copy = doc;
+    Value* plain = parser.parse(&copy[0]);
+    check(json_equals(v, plain), "stringRefs json_equals", doc);
+    check(summarize(v).stringBytes == summarize(plain).stringBytes, "stringRefs summarize", doc);
+    JEncoder encoder;
+    std::vector<char> buf = encoder.encode(v);
+    check(toJson(JEncoder::decode(buf.data(), (int)buf.size())) == toJson(plain), "stringRefs v3", doc);
+
+    //terminated on demand, once
+    const char* str = s->as_str(&allocator);
+    check(strcmp(str, "abc") == 0 && str != exact.data() + 2 && s->as_str(&allocator) == str,
+        "as_str(allocator)", doc);
+}
+
+//a malloc block of exactly n bytes, so ASan sees every read past the input
+static void checkBadInput(const std::string& doc) {
+    JsonAllocator allocator;
+    JsonParser parser(&allocator);
+    char* exact = (char*)malloc(doc.size());
+    memcpy(exact, doc.data(), doc.size());
+    Value* v = parser.parse(exact, doc.size());
+    check(!v && parser.get_error()[0], "parse(data, len) error", doc);
+    free(exact);
+
+    bool ok = true;
+    for (size_t i = 0; i < doc.size() && ok; ++i) {
+        char* c = (char*)malloc(1);
+        *c = doc[i];
+        ok = parser.feed(c, 1);
+        free(c);
+    }
+    check(!(ok && parser.finish()), "feed/finish error", doc);
+}
+
+void checkBadInputs() {
+    for (const char* doc : badDocs) {
+        checkBadInput(doc);
+    }
+    //every cut of a document ends inside an object
+    std::string doc = checkDocs[0];
+    for (size_t i = 0; i < doc.size(); ++i) {
+        checkBadInput(doc.substr(0, i));
+    }
+}
+
+//one parser for every document, the structural index grows and shrinks in place
+void checkIndexReuse() {
+    std::vector<std::string> docs = checkInputs();
+    JsonAllocator allocator;
+    JsonParser parser(&allocator);
+    for (int round = 0; round < 2; ++round) {
+        for (const std::string& doc : docs) {
+            std::string copy = doc;
+            std::string ref = toJson(parser.parse(&copy[0]));
+            check(toJson(parser.parse(doc.data(), doc.size())) == ref, "reused index", doc);
+        }
+        std::reverse(docs.begin(), docs.end());
+    }
+
+    //rejected before a byte is read
+    const char small[] = "[1]";
+    check(!parser.parse(small, (size_t)UINT32_MAX) && strstr(parser.get_error(), "too large"),
+        "input too large", small);
+    Value* v = parser.parse(small, 3);
+    check(v && v->size() == 1 && v->at(0)->as_int() == 1, "parse after too large", small);
+}
+
+struct ValidateCase {
+    const char* doc;
+    bool valid;
+    size_t offset;
+};
+
+static const ValidateCase validateCases[] = {
+    { "0", true, 0 },
+    { " [1, -2.5e+3, \"a\\u00e9\", true, false, null, {}] ", true, 0 },
+    { "{\"a\":{\"b\":[]}}", true, 0 },
+    { "\"\xc3\xa9\xe2\x82\xac\xf0\x9f\x98\x80\"", true, 0 },
+    { "", false, 0 },
+    { "   ", false, 3 },
+    { "[1,]", false, 3 },
+    { "{\"a\" 1}", false, 5 },
+    { "{1:2}", false, 1 },
+    { "01", false, 1 },
+    { "1.", false, 0 },
+    { "-", false, 0 },
+    { "[1 2]", false, 3 },
+    { "tru", false, 0 },
+    { "\"a\\x\"", false, 2 },
+    { "\"a\tb\"", false, 2 },
+    { "\"abc", false, 4 },
+    { "[1] 2", false, 4 },
+    { "\"\xc0\xaf\"", false, 1 },
+    { "\"\xed\xa0\x80\"", false, 1 },
+    { "\"\xf4\x90\x80\x80\"", false, 1 },
+    { "[\"\xe2\x82\"]", false, 2 },
+};
+
+void checkValidator() {
+    JsonValidator validator;
+    for (const ValidateCase& c : validateCases) {
+        std::string doc = c.doc;
+        //exactly sized, so a read past the end is caught
+        char* exact = (char*)malloc(doc.size());
+        memcpy(exact, doc.data(), doc.size());
+        bool ok = validator.validate(exact, doc.size());
+        check(ok == c.valid && (ok ? !validator.get_error()[0] :
+            validator.get_error()[0] && validator.get_error_offset() == c.offset), "validate", doc);
+        free(exact);
+    }
+    check(!validator.validate(NULL, 0) && validator.get_error()[0], "validate(NULL, 0)", "");
+
+    //agrees with the parser
+    for (const std::string& doc : checkInputs()) {
+        check(validator.validate(doc.data(), doc.size()), "validate document", doc);
+    }
+    for (const char* doc : badDocs) {
+        check(!validator.validate(doc, strlen(doc)), "validate bad document", doc);
+    }
+
+    std::string deep(10, '[');
+    deep += std::string(10, ']');
+    validator.maxDepth = 10;
+    check(validator.validate(deep.data(), deep.size()), "validate depth", deep);
+    validator.maxDepth = 9;
+    check(!validator.validate(deep.data(), deep.size()) && validator.get_error_offset() == 9,
+        "validate too deep", deep);
+}
+
+//RFC 3629 by code point, offset of the first bad sequence
+static size_t utf8Reference(const std::string& s) {
+    size_t i = 0;
+    size_t n = s.size();
+    while (i < n) {
+        uint8_t c = (uint8_t)s[i];
+        if (c < 0x80) {
+            ++i;
+            continue;
+        }
+        size_t len;
+        uint32_t cp;
+        if ((c & 0xE0) == 0xC0) { len = 2; cp = c & 0x1F; }
+        else if ((c & 0xF0) == 0xE0) { len = 3; cp = c & 0x0F; }
+        else if ((c & 0xF8) == 0xF0) { len = 4; cp = c & 0x07; }
+        else return i;
+        if (n - i < len) return i;
+        for (size_t k = 1; k < len; ++k) {
+            uint8_t b = (uint8_t)s[i + k];
+            if ((b & 0xC0) != 0x80) return i;
+            cp = (cp << 6) | (b & 0x3F);
+        }
+        if ((len == 2 && cp < 0x80) || (len == 3 && cp < 0x800) || (len == 4 && cp < 0x10000) ||
+            cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) return i;
+        i += len;
+    }
+    return n;
+}
+
+//the vector validator of this CPU against the reference, around block boundaries
+void checkUtf8() {
+    const char* pieces[] = {
+        "a", "~", "\xc3\xa9", "\xe2\x82\xac", "\xf0\x9f\x98\x80", "\xf4\x8f\xbf\xbf", "\xed\x9f\xbf",
+        "\xee\x80\x80", "\xc2\x80", "\xef\xbf\xbf",
+        //malformed
+        "\x80", "\xbf", "\xc0\x80", "\xc1\xbf", "\xe0\x80\x80", "\xed\xa0\x80", "\xf0\x80\x80\x80",
+        "\xf4\x90\x80\x80", "\xf5\x80\x80\x80", "\xff", "\xc3", "\xe2\x82", "\xf0\x9f\x98",
+    };
+    const int validPieces = 10;
+    const int npieces = sizeof(pieces) / sizeof(pieces[0]);
+    srand(7);
+    for (int k = 0; k < 20000; ++k) {
+        std::string text;
+        int len = rand() % 100;
+        bool broken = rand() % 2;
+        while ((int)text.size() < len) {
+            if (rand() % 3) text += (char)('a' + rand() % 26);
+            else if (broken && rand() % 16 == 0) text += pieces[validPieces + rand() % (npieces - validPieces)];
+            else text += pieces[rand() % validPieces];
+        }
+        if (rand() % 8 == 0) text += pieces[validPieces + rand() % (npieces - validPieces)];
+        std::vector<char> exact(text.begin(), text.end());
+        const char* begin = exact.data();
+        size_t got = validate_utf8(begin, begin + exact.size()) - begin;
+        check(got == utf8Reference(text), simd_level() == SimdLevel::AVX2 ? "validate_utf8 AVX2" : "validate_utf8", text);
+    }
+}
+
+//a file of exactly one page, so a read past its end leaves the mapping
+static void checkMappedFile(const std::string& head, bool valid, const char* error) {
+    std::string text = head;
+    text.resize(4096, ' ');
+    const char* path = "jsonc_check.json";
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        check(false, "create file", path);
+        return;
+    }
+    fwrite(text.data(), 1, text.size(), file);
+    fclose(file);
+
+    MappedDocument doc;
+    Value* v = doc.open(path);
+    if (valid) {
+        JsonAllocator allocator;
+        JsonParser parser(&allocator);
+        check(toJson(v) == toJson(parser.parse(&text[0])), "MappedDocument", head);
+    }
+    else {
+        check(!v && strcmp(doc.get_error(), error) == 0, "MappedDocument error", head);
+    }
+    doc.close();
+    remove(path);
+}
+
+void checkMapped() {
+    checkMappedFile("{\"a\":[1,\"x\"],\"b\":{}}", true, NULL);
+    checkMappedFile("{\"a\":1,", false, "Unexpected end of stream");
+    checkMappedFile("{\"a\"", false, "Unexpected end of stream");
+    checkMappedFile("[1,", false, "Unexpected end of stream");
+    checkMappedFile("[\"abc", false, "Unexpected end of stream in paserStr");
+}
+
+//parse the records of text with every thread count, compare with parsing them one by one
+static void checkLinesText(const std::string& text, const std::vector<std::string>& expect) {
+    for (int threads = 1; threads <= 8; ++threads) {
+        std::string buf = text;
+        JsonLinesParser lines;
+        lines.maxThreads = threads;
+        lines.minShardSize = 1;
+        bool ok = lines.parse(&buf[0], buf.size());
+        check(ok && lines.size() == expect.size(), "JsonLinesParser size", text);
+        if (!ok || lines.size() != expect.size()) continue;
+        for (size_t i = 0; i < expect.size(); ++i) {
+            if (toJson(lines.get(i)) != expect[i]) {
+                check(false, "JsonLinesParser record", text);
+                break;
+            }
+        }
+    }
+}
+
+static std::string lineRecord(int kind) {
+    switch (kind) {
+    case 0: {
+        //longer than a shard, its end is found from the shards after it
+        std::string s = "[1";
+        for (int i = 0; i < 300; ++i) s += ",1";
+        return s + "]";
+    }
+    case 1: return std::to_string(rand() % 1000);
+    case 2: return "{\"s\":\"raw\nnewline\",\"t\":\"\\\\\"}";
+    case 3: return "\"quote \\\" and \\\\\\\"\"";
+    case 4: return "{\"a\":[true,null,{\"b\":\"\\n\"}]}";
+    default: return "[]";
+    }
+}
+
+void checkLines() {
+    std::vector<std::string> expect;
+    std::string text = lineRecord(0) + "\n12\n[3,4]\n";
+    const char* parts[] = { "12", "[3,4]" };
+    expect.push_back(lineRecord(0));
+    expect.insert(expect.end(), parts, parts + 2);
+    for (std::string& e : expect) {
+        JsonAllocator allocator;
+        JsonParser parser(&allocator);
+        e = toJson(parser.parse(&e[0]));
+    }
+    checkLinesText(text, expect);
+
+    //empty lines, \r\n and blanks between records
+    const char* seps[] = { "\n", "\n\n", "\r\n", "\n  \n", " \n\t" };
+    srand(7);
+    for (int round = 0; round < 50; ++round) {
+        text.clear();
+        expect.clear();
+        int n = 1 + rand() % 40;
+        for (int i = 0; i < n; ++i) {
+            std::string r = lineRecord(rand() % 6);
+            text += r;
+            text += seps[rand() % 5];
+            JsonAllocator allocator;
+            JsonParser parser(&allocator);
+            expect.push_back(toJson(parser.parse(&r[0])));
+        }
+        checkLinesText(text, expect);
+    }
+
+    std::string bad = "1\n2\n[3,\n4\n";
+    JsonLinesParser lines;
+    check(!lines.parse(&bad[0], bad.size()) && strncmp(lines.get_error(), "record 2:", 9) == 0,
+        "JsonLinesParser error", bad);
+
+    const char* path = "jsonc_check.jsonl";
+    FILE* file = fopen(path, "wb");
+    if (file) {
+        fputs("{\"a\":1}\n[2]\n", file);
+        fclose(file);
+        check(lines.parse_file(path) && lines.size() == 2 && lines.get(0)->get_int("a") == 1,
+            "JsonLinesParser::parse_file", path);
+        remove(path);
+    }
+}
+
+struct ProjectCase {
+    //paths separated by spaces
+    const char* paths;
+    const char* result;
+};
+
+static const char* projectDoc =
+    "{\"user\":{\"id\":7,\"name\":\"x\",\"tags\":[1,2]},"
+    "\"items\":[{\"a\":1,\"b\":2},{\"a\":3,\"b\":4},{\"c\":5}],\"s\":\"str\",\"k~/\":1}";
+
+static const ProjectCase projectCases[] = {
+    { "/user/id", "{\"user\":{\"id\":7}}" },
+    { "/items/*/a", "{\"items\":[{\"a\":1},{\"a\":3}]}" },
+    { "/items/1", "{\"items\":[{\"a\":3,\"b\":4}]}" },
+    { "/user", "{\"user\":{\"id\":7,\"name\":\"x\",\"tags\":[1,2]}}" },
+    { "/user/tags/1 /s", "{\"user\":{\"tags\":[2]},\"s\":\"str\"}" },
+    { "/*/id /k~0~1", "{\"user\":{\"id\":7},\"k~/\":1}" },
+    { "/missing", "{}" },
+    { "/s/x", "{}" },
+};
+
+static JsonProjection* newProjection(const char* paths) {
+    JsonProjection* proj = new JsonProjection();
+    std::string all = paths;
+    size_t pos = 0;
+    while (pos <= all.size()) {
+        size_t next = all.find(' ', pos);
+        if (next == std::string::npos) next = all.size();
+        proj->add(all.substr(pos, next - pos).c_str());
+        pos = next + 1;
+    }
+    return proj;
+}
+
+void checkProjection() {
+    JsonAllocator allocator;
+    JsonParser parser(&allocator);
+    std::string doc = projectDoc;
+    std::vector<char> exact(doc.begin(), doc.end());
+    for (const ProjectCase& c : projectCases) {
+        JsonProjection* proj = newProjection(c.paths);
+        Value* v = proj->parse(exact.data(), exact.size(), &allocator);
+        check(v && json_equals(v, parser.parse(c.result, strlen(c.result))), "JsonProjection", c.paths);
+        delete proj;
+    }
+    JsonProjection whole;
+    whole.add("");
+    check(json_equals(whole.parse(exact.data(), exact.size(), &allocator), parser.parse(doc.data(), doc.size())),
+        "JsonProjection whole", doc);
+
+    const char* bad[] = {
+        "{\"a\":\"unterminated",
+        "{\"a\":,}",
+        "{\"a\":{\"b\":1}",
+        "{\"a\" 1}",
+        "{\"x\":[1,}",
+        "[1,",
+        "",
+    };
+    JsonProjection proj;
+    proj.add("/a/b");
+    for (const char* text : bad) {
+        size_t len = strlen(text);
+        char* buf = (char*)malloc(len);
+        memcpy(buf, text, len);
+        check(!proj.parse(buf, len, &allocator) && proj.get_error()[0], "JsonProjection error", text);
+        free(buf);
+    }
+}
+
+//malloc blocks, counted so leaks and late frees show up
+class CountingSource : public MemorySource {
+public:
+    std::atomic<long> blocks;
+    CountingSource() : blocks(0) {}
+    void* alloc_block(size_t size) override {
+        ++blocks;
+        return malloc(size);
+    }
+    void free_block(void* block, size_t) override {
+        --blocks;
+        free(block);
+    }
+};
+
+void checkPool() {
+    std::string doc = checkDocs[0];
+    CountingSource source;
+    {
+        JsonAllocatorPool pool(4096);
+        pool.source = &source;
+        pool.maxCached = 2;
+        JsonAllocator* a = pool.acquire();
+        pool.release(a);
+        check(pool.cached() == 1 && pool.acquire() == a, "JsonAllocatorPool reuse", doc);
+        pool.release(a);
+        {
+            AllocatorLease l1 = pool.lease();
+            AllocatorLease l2 = pool.lease();
+            AllocatorLease l3 = pool.lease();
+            JsonParser parser(l1);
+            std::string copy = doc;
+            check(parser.parse(&copy[0]) != NULL, "AllocatorLease parse", doc);
+        }
+        check(pool.cached() == 2, "JsonAllocatorPool maxCached", doc);
+        pool.trim();
+        check(pool.cached() == 0 && source.blocks == 0, "JsonAllocatorPool trim", doc);
+    }
+
+    //threads that outlive the pool keep allocators cached in it
+    JsonAllocatorPool* shared = new JsonAllocatorPool(4096);
+    shared->source = &source;
+    std::atomic<int> ready(0);
+    std::atomic<bool> done(false);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; ++i) {
+        threads.push_back(std::thread([&]() {
+            {
+                AllocatorLease arena = shared->lease();
+                JsonParser parser(arena);
+                std::string copy = doc;
+                parser.parse(&copy[0]);
+            }
+            ++ready;
+            while (!done) std::this_thread::yield();
+        }));
+    }
+    while (ready < 4) std::this_thread::yield();
+    check(source.blocks == 4, "JsonAllocatorPool thread caches", doc);
+    delete shared;
+    check(source.blocks == 0, "~JsonAllocatorPool drains every thread", doc);
+    done = true;
+    for (std::thread& t : threads) t.join();
+    check(source.blocks == 0, "JsonAllocatorPool source", doc);
+}
+
+//a parser that resets its allocator between documents stops asking for blocks
+void checkReset() {
+    std::vector<std::string> docs = checkInputs();
+    CountingSource source;
+    {
+        JsonAllocator allocator(1024);
+        allocator.set_source(&source);
+        JsonParser parser(&allocator);
+        for (const std::string& doc : docs) {
+            allocator.reset();
+            std::string copy = doc;
+            std::string ref = toJson(parser.parse(&copy[0]));
+            AllocatorStats warm = allocator.get_stats();
+            long blocks = source.blocks;
+            for (int round = 0; round < 3; ++round) {
+                allocator.reset();
+                AllocatorStats empty = allocator.get_stats();
+                check(empty.requested == 0 && empty.blocks == 0 && empty.reserved == 0 &&
+                    empty.retained >= warm.reserved, "reset keeps the blocks", doc);
+                copy = doc;
+                std::string json = toJson(parser.parse(&copy[0]));
+                check(json == ref && source.blocks == blocks && allocator.get_stats().requested == warm.requested,
+                    "parse after reset", doc);
+            }
+        }
+
+        allocator.reset();
+        size_t retained = allocator.get_stats().retained;
+        allocator.trim(retained / 2);
+        check(allocator.get_stats().retained <= retained / 2, "trim(keep)", "");
+        allocator.trim();
+        check(allocator.get_stats().retained == 0 && source.blocks == 0, "trim", "");
+        std::string copy = docs[0];
+        check(parser.parse(&copy[0]) && source.blocks > 0, "parse after trim", docs[0]);
+    }
+    check(source.blocks == 0, "~JsonAllocator after reset", "");
+}
+
+static bool inBuffer(const void* p, const char* buffer, size_t size) {
+    return (const char*)p >= buffer && (const char*)p < buffer + size;
+}
+
+//allocations fill the caller's buffer first, it is reused but never freed
+void checkExternalBuffer() {
+    std::string small = "{\"a\":[1,2,3],\"b\":\"text\"}";
+    std::vector<std::string> docs = checkInputs();
+    std::string large = docs.back();
+    CountingSource source;
+    //on the heap, so ASan reports a free of it or a write past it
+    char* buffer = (char*)malloc(4096);
+    {
+        JsonAllocator allocator(buffer, 4096, 1024);
+        allocator.set_source(&source);
+        JsonParser parser(&allocator);
+        std::string copy = small;
+        Value* v = parser.parse(&copy[0]);
+        check(v && inBuffer(v, buffer, 4096) && source.blocks == 0, "external buffer", small);
+
+        copy = large;
+        std::string ref = toJson(parser.parse(&copy[0]));
+        check(!parser.get_error()[0] && source.blocks > 0, "external buffer overflow", large);
+        AllocatorStats stats = allocator.get_stats();
+        check(stats.reserved >= 4096 + 1024 && stats.blocks >= 2, "external buffer stats", large);
+
+        allocator.reset();
+        allocator.trim();
+        check(source.blocks == 0 && allocator.get_stats().retained >= 4000, "trim keeps the external buffer", large);
+        copy = small;
+        v = parser.parse(&copy[0]);
+        check(v && inBuffer(v, buffer, 4096) && source.blocks == 0, "external buffer after trim", small);
+
+        copy = large;
+        JsonAllocator other;
+        JsonNode* clone = parser.parse(&copy[0])->clone_into(&other);
+        allocator.reset();
+        check(toJson(clone) == ref, "external buffer clone_into", large);
+    }
+    check(source.blocks == 0, "~JsonAllocator with an external buffer", small);
+    free(buffer);
+
+    //too small to hold a block header, the heap is used
+    char tiny[8];
+    JsonAllocator allocator(tiny, sizeof(tiny));
+    JsonNode* n = allocator.alloc_int(1);
+    check(n && !inBuffer(n, tiny, sizeof(tiny)) && n->as_int() == 1, "tiny external buffer", "");
+}
+
+//blocks freed by one allocator are handed to the next, upstream only sees the first
+void checkBlockPool() {
+    std::vector<std::string> docs = checkInputs();
+    std::string doc = docs.back();
+    CountingSource source;
+    {
+        BlockPool pool(&source);
+        std::string ref;
+        {
+            JsonAllocator allocator(1024);
+            allocator.set_source(&pool);
+            JsonParser parser(&allocator);
+            std::string copy = doc;
+            ref = toJson(parser.parse(&copy[0]));
+        }
+        long blocks = source.blocks;
+        check(blocks > 0, "BlockPool upstream", doc);
+        for (int round = 0; round < 3; ++round) {
+            JsonAllocator allocator(1024);
+            allocator.set_source(&pool);
+            JsonParser parser(&allocator);
+            std::string copy = doc;
+            check(toJson(parser.parse(&copy[0])) == ref && source.blocks == blocks, "BlockPool reuse", doc);
+        }
+
+        //shared by threads, each with its own allocators
+        std::vector<std::thread> threads;
+        std::atomic<int> failed(0);
+        for (int t = 0; t < 4; ++t) {
+            threads.push_back(std::thread([&]() {
+                for (int k = 0; k < 20; ++k) {
+                    JsonAllocator allocator(1024);
+                    allocator.set_source(&pool);
+                    JsonParser parser(&allocator);
+                    std::string copy = doc;
+                    if (toJson(parser.parse(&copy[0])) != ref) ++failed;
+                }
+            }));
+        }
+        for (std::thread& t : threads) t.join();
+        check(failed == 0, "BlockPool threads", doc);
+
+        pool.trim();
+        check(source.blocks == 0, "BlockPool trim", doc);
+
+        //nothing is kept past maxRetained
+        pool.maxRetained = 0;
+        {
+            JsonAllocator allocator(1024);
+            allocator.set_source(&pool);
+            JsonParser parser(&allocator);
+            std::string copy = doc;
+            parser.parse(&copy[0]);
+        }
+        check(source.blocks == 0, "BlockPool maxRetained", doc);
+    }
+
+    //whole pages, aligned and writable to the last byte
+    PageSource pages;
+    size_t page = 4096;
+#ifndef _WIN32
+    page = (size_t)sysconf(_SC_PAGESIZE);
+#endif
+    char* block = (char*)pages.alloc_block(page + 1);
+    check(block && (uintptr_t)block % page == 0, "PageSource alloc_block", "");
+    if (block) {
+        memset(block, 1, page * 2);
+        pages.free_block(block, page + 1);
+    }
+    pages.hugePages = HugePages::Transparent;
+    pages.numaNode = PageSource::NumaLocal;
+    JsonAllocator allocator(64 * 1024);
+    allocator.set_source(&pages);
+    JsonParser parser(&allocator);
+    for (const std::string& text : docs) {
+        std::string copy = text;
+        std::string ref = toJson(parser.parse(&copy[0]));
+        copy = text;
+        JsonParser plain;
+        JsonAllocator heap;
+        plain.init(&heap);
+        check(toJson(plain.parse(&copy[0])) == ref, "PageSource parse", text);
+    }
+}
+
+static const char* summaryDoc = "{\"a\":[1,2.5,\"x\\ny\",true,null,{\"bc\":{}}],\"de\":\"fgh\",\"i\":-3}";
+
+static bool knownSummary(ParseSummary sum) {
+    return sum.count(Type::Object) == 3 && sum.count(Type::Array) == 1 && sum.count(Type::Integer) == 2 &&
+        sum.count(Type::Float) == 1 && sum.count(Type::String) == 2 && sum.count(Type::Boolean) == 1 &&
+        sum.count(Type::Null) == 1 && sum.total() == 11 && sum.stringBytes == 6 && sum.keyBytes == 6 &&
+        sum.maxDepth == 4;
+}
+
+void checkStats() {
+    //the same counts for every representation
+    std::string doc = summaryDoc;
+    JsonAllocator allocator;
+    JsonParser parser(&allocator);
+    std::string copy = doc;
+    Value* tree = parser.parse(&copy[0]);
+    check(knownSummary(summarize(tree)) && knownSummary(parser.get_summary()), "summarize", doc);
+    check(knownSummary(summarize(parser.parse(doc.data(), doc.size()))), "summarize parse(data, len)", doc);
+    parser.stringRefs = true;
+    check(knownSummary(summarize(parser.parse(doc.data(), doc.size()))), "summarize stringRefs", doc);
+    parser.stringRefs = false;
+    std::string tape = doc;
+    check(knownSummary(summarize(parser.parse_tape(&tape[0]))), "summarize tape", doc);
+    JEncoder encoder;
+    std::vector<char> buf = encoder.encode(tree);
+    check(knownSummary(summarize(JEncoder::decode(buf.data(), (int)buf.size()))), "summarize v3", doc);
+    check(knownSummary(summarize(tree->clone_into(&allocator))), "summarize clone_into", doc);
+
+    Value scalar(Type::Integer);
+    ParseSummary one = summarize(&scalar);
+    check(one.total() == 1 && one.maxDepth == 0 && summarize(NULL).total() == 0, "summarize scalar", "");
+
+    //a block of 1024, then one large allocation beside it
+    JsonAllocator counted(1024);
+    AllocatorStats stats = counted.get_stats();
+    check(stats.requested == 0 && stats.reserved == 0 && stats.blocks == 0 && stats.highWater == 0, "get_stats empty", "");
+    counted.allocate_raw(100);
+    stats = counted.get_stats();
+    bool ok = stats.requested == 100 && stats.blocks == 1 && stats.reserved == 1024 &&
+        stats.available < 1024 - 104 && stats.available > 1024 - 104 - 64 &&
+        stats.fragmentation == stats.reserved - stats.requested - stats.available && stats.largeAllocs == 0;
+    check(ok, "get_stats block", "");
+    size_t available = stats.available;
+    counted.allocate_raw(5000);
+    stats = counted.get_stats();
+    ok = stats.requested == 5100 && stats.blocks == 2 && stats.reserved > 1024 + 5000 &&
+        stats.available == available && stats.largeAllocs == 1 && stats.highWater == stats.reserved;
+    check(ok, "get_stats large", "");
+    size_t reserved = stats.reserved;
+    counted.reset();
+    stats = counted.get_stats();
+    ok = stats.requested == 0 && stats.reserved == 0 && stats.blocks == 0 && stats.largeAllocs == 0 &&
+        stats.retained == reserved && stats.highWater == reserved;
+    check(ok, "get_stats reset", "");
+    counted.trim();
+    check(counted.get_stats().retained == 0, "get_stats trim", "");
+}
+
+//text in an exactly sized buffer, so the number ends at its last byte
+static void checkNumber(const std::string& text) {
+    char* buf = new char[text.size() + 1];
+    memcpy(buf, text.c_str(), text.size() + 1);
+    JsonAllocator allocator;
+    JsonParser parser(&allocator);
+    Value* v = parser.parse(buf);
+    Value bounded;
+    const char* end = parse_number(buf, buf + text.size(), &bounded);
+    bool ok = v && end == buf + text.size() && v->type() == bounded.type();
+    if (ok && v->type() == Type::Integer) {
+        errno = 0;
+        long long i = strtoll(text.c_str(), NULL, 10);
+        ok = errno == 0 && text.find_first_of(".eE") == std::string::npos &&
+            v->as_int() == i && bounded.as_int() == i;
+    }
+    else if (ok) {
+        //correctly rounded, bit for bit
+        double d = strtod(text.c_str(), NULL);
+        double a = v->as_float();
+        double b = bounded.as_float();
+        ok = memcmp(&a, &d, sizeof(d)) == 0 && memcmp(&b, &d, sizeof(d)) == 0;
+    }
+    check(ok, "number", text);
+    delete[] buf;
+}
+
+#ifndef _WIN32
+//NUL terminated numbers that end on the last byte before an unmapped page
+static void checkNumbersAtPageEnd() {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    char* area = (char*)mmap(NULL, page * 2, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (area == MAP_FAILED) return;
+    mprotect(area + page, page, PROT_NONE);
+    std::string text;
+    for (int digits = 1; digits <= 20; ++digits) {
+        text += (char)('1' + digits % 9);
+        for (int shift = 0; shift < 8; ++shift) {
+            //the NUL is the last byte of the page, shift leaves a few spaces before it
+            char* buf = area + page - 1 - shift - text.size();
+            memset(buf, ' ', text.size() + shift);
+            memcpy(buf, text.c_str(), text.size());
+            area[page - 1] = 0;
+            JsonAllocator allocator;
+            JsonParser parser(&allocator);
+            Value* v = parser.parse(buf);
+            Value unbounded;
+            const char* end = parse_number(buf, NULL, &unbounded);
+            bool ok = v && end == buf + text.size() && v->type() == unbounded.type();
+            if (ok && v->type() == Type::Integer) {
+                long long i = strtoll(text.c_str(), NULL, 10);
+                ok = v->as_int() == i && unbounded.as_int() == i;
+            }
+            else if (ok) {
+                double d = strtod(text.c_str(), NULL);
+                ok = v->as_float() == d && unbounded.as_float() == d;
+            }
+            check(ok, "number at page end", text);
+        }
+    }
+    munmap(area, page * 2);
+}
+#endif
+
+void checkNumbers() {
+#ifndef _WIN32
+    checkNumbersAtPageEnd();
+#endif
+    const char* fixed[] = {
+        "0", "-0", "-0.0", "7", "12345678", "123456789", "1234567890123456",
+        "9223372036854775807", "-9223372036854775808", "9223372036854775808",
+        "123456789012345678901234567890", "0.1", "0.3", "1e308", "1.7976931348623157e308",
+        "4.9e-324", "2.2250738585072011e-308", "2.2250738585072014e-308", "9007199254740993",
+        "1e23", "8.98846567431158e307", "0.000001", "1E-7", "3.14159265358979323846",
+    };
+    for (const char* text : fixed) checkNumber(text);
+
+    srand(42);
+    for (int k = 0; k < 20000; ++k) {
+        std::string text;
+        if (rand() % 4 == 0) text += '-';
+        int digits = 1 + rand() % 25;
+        text += (char)('1' + rand() % 9);
+        for (int d = 1; d < digits; ++d) text += (char)('0' + rand() % 10);
+        if (rand() % 2) {
+            text += '.';
+            int n = 1 + rand() % 20;
+            for (int d = 0; d < n; ++d) text += (char)('0' + rand() % 10);
+        }
+        if (rand() % 3 == 0) {
+            text += rand() % 2 ? "e-" : "e";
+            text += std::to_string(rand() % 330);
+        }
+        checkNumber(text);
+    }
+}
+
+//every member of ref is found by name in the v3 copy
+static bool keysFound(Value* ref, Value* v3) {
+    if (ref->type() != v3->type()) return false;
+    if (ref->type() == Type::Object) {
+        for (auto it = ref->begin(); it != ref->end(); ++it) {
+            Value* m = v3->get(it.get_name());
+            if (!m || !keysFound(*it, m)) return false;
+        }
+    }
+    else if (ref->type() == Type::Array) {
+        auto b = v3->begin();
+        for (auto it = ref->begin(); it != ref->end(); ++it, ++b) {
+            if (!keysFound(*it, *b)) return false;
+        }
+    }
+    return true;
+}
+
+//{"a":1,"b":{"c":[1,2,"x"]},"d":"e"} from the version 3 encoder, the root _len is not cleared
+static const unsigned char oldJcxx[] = {
+    0x4a,0x43,0x58,0x58,0x03,0x00,0x00,0x00,0x1c,0x00,0x00,0x00,0x06,0x00,0x00,0x00,
+    0x61,0x00,0x62,0x00,0x63,0x00,0x78,0x00,0x64,0x00,0x65,0x00,0x1c,0x00,0x00,0x00,
+    0x03,0x00,0x00,0x00,0x03,0x01,0x5e,0xb8,0xff,0x7f,0x00,0x00,0x10,0x00,0x00,0x00,
+    0x44,0x00,0x00,0x00,0x12,0x00,0x00,0x00,0x54,0x00,0x00,0x00,0x18,0x00,0x00,0x00,
+    0xb8,0x00,0x00,0x00,0x01,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x04,0x00,0x00,0x00,
+    0x00,0x00,0x00,0x00,0x54,0x00,0x00,0x00,0x01,0x00,0x00,0x00,0x03,0x01,0x17,0x12,
+    0x06,0x56,0x00,0x00,0x14,0x00,0x00,0x00,0x6c,0x00,0x00,0x00,0x6c,0x00,0x00,0x00,
+    0x03,0x00,0x00,0x00,0x02,0x01,0x17,0x12,0x06,0x56,0x00,0x00,0x88,0x00,0x00,0x00,
+    0x98,0x00,0x00,0x00,0xa8,0x00,0x00,0x00,0x01,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
+    0x04,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x02,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
+    0x04,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0xa8,0x00,0x00,0x00,0x16,0x00,0x00,0x00,
+    0x01,0x01,0x17,0x12,0x06,0x56,0x00,0x00,0xb8,0x00,0x00,0x00,0x1a,0x00,0x00,0x00,
+    0x01,0x01,0x11,0x52,0x06,0x56,0x00,0x00,
+};
+
+void checkEncoder() {
+    std::vector<std::string> docs = checkInputs();
+    size_t indexKeys[] = { JSONC_INDEX_MIN_KEYS, 1, 0 };
+    for (const std::string& doc : docs) {
+        JsonAllocator allocator;
+        JsonParser parser(&allocator);
+        std::string copy = doc;
+        Value* root = parser.parse(&copy[0]);
+        std::string ref = toJson(root);
+        for (size_t n : indexKeys) {
+            JEncoder encoder;
+            encoder.indexKeys = n;
+            std::vector<char> buf = encoder.encode(root);
+            check(MappedDocument::detect(buf.data(), buf.size()) == DocFormat::JCXX3, "v3 detect", doc);
+            Value* v = JEncoder::decode(buf.data(), (int)buf.size());
+            check(v && toJson(v) == ref, "v3 round trip", doc);
+            check(v && keysFound(root, v), "v3 get", doc);
+        }
+    }
+
+    std::vector<char> old(oldJcxx, oldJcxx + sizeof(oldJcxx));
+    std::string name = "old v3 file";
+    check(MappedDocument::detect(old.data(), old.size()) == DocFormat::JCXX3, "v3 detect", name);
+    Value* v = JEncoder::decode(old.data(), (int)old.size());
+    JsonAllocator allocator;
+    JsonParser parser(&allocator);
+    std::string text = "{\"a\":1,\"b\":{\"c\":[1,2,\"x\"]},\"d\":\"e\"}";
+    check(v && toJson(v) == toJson(parser.parse(&text[0])), "v3 round trip", name);
+    check(v && v->get_int("a") == 1 && v->get("b")->get("c")->size() == 3 &&
+        strcmp(v->get_str("d"), "e") == 0, "v3 get", name);
+}
+
+struct PatchCase {
+    const char* doc;
+    const char* patch;
+    //NULL: the patch must fail
+    const char* result;
+};
+
+//RFC 7386 section 3 and appendix A
+static const PatchCase mergeCases[] = {
+    { "{\"title\":\"Goodbye!\",\"author\":{\"givenName\":\"John\",\"familyName\":\"Doe\"},\"tags\":[\"example\",\"sample\"],\"content\":\"This will be unchanged\"}",
+      "{\"title\":\"Hello!\",\"phoneNumber\":\"+01-234-567-8901\",\"author\":{\"familyName\":null},\"tags\":[\"example\"]}",
+      "{\"title\":\"Hello!\",\"author\":{\"givenName\":\"John\"},\"tags\":[\"example\"],\"content\":\"This will be unchanged\",\"phoneNumber\":\"+01-234-567-8901\"}" },
+    { "{\"a\":\"b\"}", "{\"a\":\"c\"}", "{\"a\":\"c\"}" },
+    { "{\"a\":\"b\"}", "{\"b\":\"c\"}", "{\"a\":\"b\",\"b\":\"c\"}" },
+    { "{\"a\":\"b\"}", "{\"a\":null}", "{}" },
+    { "{\"a\":\"b\",\"b\":\"c\"}", "{\"a\":null}", "{\"b\":\"c\"}" },
+    { "{\"a\":[\"b\"]}", "{\"a\":\"c\"}", "{\"a\":\"c\"}" },
+    { "{\"a\":\"c\"}", "{\"a\":[\"b\"]}", "{\"a\":[\"b\"]}" },
+    { "{\"a\":{\"b\":\"c\"}}", "{\"a\":{\"b\":\"d\",\"c\":null}}", "{\"a\":{\"b\":\"d\"}}" },
+    { "{\"a\":[{\"b\":\"c\"}]}", "{\"a\":[1]}", "{\"a\":[1]}" },
+    { "[\"a\",\"b\"]", "[\"c\",\"d\"]", "[\"c\",\"d\"]" },
+    { "{\"a\":\"b\"}", "[\"c\"]", "[\"c\"]" },
+    { "{\"a\":\"foo\"}", "null", "null" },
+    { "{\"a\":\"foo\"}", "\"bar\"", "\"bar\"" },
+    { "{\"e\":null}", "{\"a\":1}", "{\"e\":null,\"a\":1}" },
+    { "[1,2]", "{\"a\":\"b\",\"c\":null}", "{\"a\":\"b\"}" },
+    { "{}", "{\"a\":{\"bb\":{\"ccc\":null}}}", "{\"a\":{\"bb\":{}}}" },
+};
+
+//RFC 6902 appendix A, then the errors of section 4 and 5
+static const PatchCase applyCases[] = {
+    { "{\"foo\":\"bar\"}", "[{\"op\":\"add\",\"path\":\"/baz\",\"value\":\"qux\"}]", "{\"baz\":\"qux\",\"foo\":\"bar\"}" },
+    { "{\"foo\":[\"bar\",\"baz\"]}", "[{\"op\":\"add\",\"path\":\"/foo/1\",\"value\":\"qux\"}]", "{\"foo\":[\"bar\",\"qux\",\"baz\"]}" },
+    { "{\"baz\":\"qux\",\"foo\":\"bar\"}", "[{\"op\":\"remove\",\"path\":\"/baz\"}]", "{\"foo\":\"bar\"}" },
+    { "{\"foo\":[\"bar\",\"qux\",\"baz\"]}", "[{\"op\":\"remove\",\"path\":\"/foo/1\"}]", "{\"foo\":[\"bar\",\"baz\"]}" },
+    { "{\"baz\":\"qux\",\"foo\":\"bar\"}", "[{\"op\":\"replace\",\"path\":\"/baz\",\"value\":\"boo\"}]", "{\"baz\":\"boo\",\"foo\":\"bar\"}" },
+    { "{\"foo\":{\"bar\":\"baz\",\"waldo\":\"fred\"},\"qux\":{\"corge\":\"grault\"}}",
+      "[{\"op\":\"move\",\"from\":\"/foo/waldo\",\"path\":\"/qux/thud\"}]",
+      "{\"foo\":{\"bar\":\"baz\"},\"qux\":{\"corge\":\"grault\",\"thud\":\"fred\"}}" },
+    { "{\"foo\":[\"all\",\"grass\",\"cows\",\"eat\"]}", "[{\"op\":\"move\",\"from\":\"/foo/1\",\"path\":\"/foo/3\"}]",
+      "{\"foo\":[\"all\",\"cows\",\"eat\",\"grass\"]}" },
+    { "{\"baz\":\"qux\",\"foo\":[\"a\",2,\"c\"]}",
+      "[{\"op\":\"test\",\"path\":\"/baz\",\"value\":\"qux\"},{\"op\":\"test\",\"path\":\"/foo/1\",\"value\":2}]",
+      "{\"baz\":\"qux\",\"foo\":[\"a\",2,\"c\"]}" },
+    { "{\"foo\":\"bar\"}", "[{\"op\":\"add\",\"path\":\"/child\",\"value\":{\"grandchild\":{}}}]",
+      "{\"foo\":\"bar\",\"child\":{\"grandchild\":{}}}" },
+    { "{\"/\":9,\"~1\":10}", "[{\"op\":\"test\",\"path\":\"/~01\",\"value\":10}]", "{\"/\":9,\"~1\":10}" },
+    { "{\"foo\":[\"bar\"]}", "[{\"op\":\"add\",\"path\":\"/foo/-\",\"value\":[\"abc\",\"def\"]}]", "{\"foo\":[\"bar\",[\"abc\",\"def\"]]}" },
+    { "{\"a\":{\"b\":1}}", "[{\"op\":\"copy\",\"from\":\"/a\",\"path\":\"/c\"},{\"op\":\"replace\",\"path\":\"/c/b\",\"value\":2}]",
+      "{\"a\":{\"b\":1},\"c\":{\"b\":2}}" },
+    { "{\"a\":1}", "[{\"op\":\"replace\",\"path\":\"\",\"value\":[1]},{\"op\":\"add\",\"path\":\"/0\",\"value\":0}]", "[0,1]" },
+    { "{\"baz\":\"qux\"}", "[{\"op\":\"test\",\"path\":\"/baz\",\"value\":\"bar\"}]", NULL },
+    { "{\"foo\":\"bar\"}", "[{\"op\":\"add\",\"path\":\"/baz/bat\",\"value\":\"qux\"}]", NULL },
+    { "{\"/\":9,\"~1\":10}", "[{\"op\":\"test\",\"path\":\"/~01\",\"value\":\"10\"}]", NULL },
+    { "{\"a\":{\"b\":1}}", "[{\"op\":\"move\",\"from\":\"/a\",\"path\":\"/a/c\"}]", NULL },
+    { "[1,2,3]", "[{\"op\":\"add\",\"path\":\"/4\",\"value\":4}]", NULL },
+    { "[1,2,3]", "[{\"op\":\"remove\",\"path\":\"/01\"}]", NULL },
+    { "[1,2,3]", "[{\"op\":\"remove\",\"path\":\"/3\"}]", NULL },
+    { "{\"a\":1}", "[{\"op\":\"invent\",\"path\":\"/a\"}]", NULL },
+    { "{\"a\":1}", "[{\"op\":\"add\",\"path\":\"/b\"}]", NULL },
+    { "{\"a\":1}", "[{\"op\":\"remove\",\"path\":\"\"}]", NULL },
+    { "{\"a\":1}", "[{\"op\":\"add\",\"path\":\"a\",\"value\":1}]", NULL },
+};
+
+static void checkPatchCases(const PatchCase* cases, size_t n, bool isMerge) {
+    //one patcher for all documents, its path cache must follow the root
+    JsonAllocator allocator;
+    JsonParser parser(&allocator);
+    JsonPatcher patcher(&allocator);
+    for (size_t i = 0; i < n; ++i) {
+        const PatchCase& c = cases[i];
+        JsonNode* doc = (JsonNode*)parser.parse(c.doc, strlen(c.doc));
+        Value* patch = parser.parse(c.patch, strlen(c.patch));
+        bool ok = isMerge ? patcher.merge(doc, patch) : patcher.apply(doc, patch);
+        if (!c.result) {
+            check(!ok && patcher.get_error()[0], "patch must fail", c.patch);
+            continue;
+        }
+        Value* result = parser.parse(c.result, strlen(c.result));
+        check(ok && json_equals(doc, result), isMerge ? "merge" : "apply", c.patch);
+    }
+}
+
+void checkPatch() {
+    checkPatchCases(mergeCases, sizeof(mergeCases) / sizeof(mergeCases[0]), true);
+    checkPatchCases(applyCases, sizeof(applyCases) / sizeof(applyCases[0]), false);
+
+    JsonAllocator allocator;
+    JsonParser parser(&allocator);
+    const char* a = "{\"x\":[1,2.0,{\"y\":null}],\"z\":\"s\"}";
+    const char* b = "{\"z\":\"s\",\"x\":[1.0,2,{\"y\":null}]}";
+    const char* c = "{\"z\":\"s\",\"x\":[1,2,{\"y\":false}]}";
+    //the same parent path on another document must not come from the cache
+    JsonPatcher patcher(&allocator);
+    const char* ops = "[{\"op\":\"add\",\"path\":\"/p/q/r\",\"value\":1}]";
+    const char* doc = "{\"p\":{\"q\":{}}}";
+    const char* result = "{\"p\":{\"q\":{\"r\":1}}}";
+    JsonNode* first = (JsonNode*)parser.parse(doc, strlen(doc));
+    JsonNode* second = (JsonNode*)parser.parse(doc, strlen(doc));
+    Value* patch = parser.parse(ops, strlen(ops));
+    Value* expect = parser.parse(result, strlen(result));
+    bool ok = patcher.apply(first, patch) && patcher.apply(second, patch);
+    check(ok && json_equals(first, expect) && json_equals(second, expect), "apply twice", ops);
+
+    Value* va = parser.parse(a, strlen(a));
+    check(json_equals(va, parser.parse(b, strlen(b))), "json_equals", b);
+    check(!json_equals(va, parser.parse(c, strlen(c))), "json_equals", c);
+}
+
+//children in model order through at(), iteration and to_json
+static bool sameChildren(Value* arr, const std::vector<int64_t>& model) {
+    if (arr->size() != model.size() || arr->at(model.size())) return false;
+    std::string json = "[";
+    for (size_t i = 0; i < model.size(); ++i) {
+        Value* v = arr->at(i);
+        if (!v || v->as_int() != model[i]) return false;
+        if (i) json += ",";
+        json += std::to_string((long long)model[i]);
+    }
+    json += "]";
+    size_t i = 0;
+    for (auto it = arr->begin(); it != arr->end(); ++it, ++i) {
+        if (i >= model.size() || (*it)->as_int() != model[i]) return false;
+    }
+    std::string ref = json;
+    JsonAllocator allocator;
+    JsonParser parser(&allocator);
+    return i == model.size() && toJson(arr) == toJson(parser.parse(&ref[0]));
+}
+
+//random edits of one array, checked against a vector after every step
+void checkChildArray() {
+    srand(11);
+    for (int round = 0; round < 50; ++round) {
+        JsonAllocator allocator;
+        JsonNode* arr = allocator.allocNode(Type::Array);
+        std::vector<int64_t> model;
+        std::string ops;
+        int64_t next = 0;
+        for (int k = 0; k < 300; ++k) {
+            int op = rand() % 8;
+            if (op <= 2) {
+                arr->append(allocator.alloc_int(next), &allocator);
+                check(arr->_flag == 5, "append makes an array", ops);
+                model.push_back(next++);
+                ops += "append ";
+            }
+            else if (op == 3) {
+                size_t i = rand() % (model.size() + 2);
+                arr->insert_at(i, allocator.alloc_int(next), &allocator);
+                model.insert(model.begin() + (i < model.size() ? i : model.size()), next++);
+                ops += "insert_at ";
+            }
+            else if (op == 4) {
+                size_t i = rand() % (model.size() + 1);
+                JsonNode* removed = arr->remove_at(i);
+                if (i < model.size()) {
+                    check(removed && removed->as_int() == model[i] && !removed->_next, "remove_at", ops);
+                    model.erase(model.begin() + i);
+                }
+                else {
+                    check(!removed, "remove_at out of range", ops);
+                }
+                ops += "remove_at ";
+            }
+            else if (op == 5) {
+                arr->reverse();
+                check(arr->_flag == 0, "reverse makes a list", ops);
+                std::reverse(model.begin(), model.end());
+                ops += "reverse ";
+            }
+            else if (op == 6) {
+                arr->insert(allocator.alloc_int(next));
+                check(arr->_flag == 0, "insert makes a list", ops);
+                model.insert(model.begin(), next++);
+                ops += "insert ";
+            }
+            else {
+                arr->_append(allocator.alloc_int(next));
+                model.push_back(next++);
+                ops += "_append ";
+            }
+            if (!sameChildren(arr, model)) {
+                check(false, "ChildArray", ops);
+                break;
+            }
+        }
+        check(toJson(arr->clone_into(&allocator)) == toJson(arr), "ChildArray clone_into", ops);
+    }
+
+    //objects: append_pair, lookup and removal by key
+    JsonAllocator allocator;
+    JsonNode* obj = allocator.allocNode(Type::Object);
+    for (int i = 0; i < 100; ++i) {
+        obj->append_pair(allocator.strdup(std::to_string(i).c_str()), allocator.alloc_int(i), &allocator);
+    }
+    bool ok = obj->_flag == 5 && obj->size() == 100;
+    for (int i = 0; i < 100 && ok; i += 3) {
+        JsonNode* removed = obj->remove(std::to_string(i).c_str());
+        ok = removed && removed->as_int() == i && !obj->get(std::to_string(i).c_str());
+    }
+    for (int i = 1; i < 100 && ok; i += 3) {
+        Value* v = obj->get(std::to_string(i).c_str());
+        ok = v && v->as_int() == i;
+    }
+    check(ok && obj->size() == 66, "ChildArray object", "append_pair/remove");
+}
+
+//the copy must not point into the source, which is wiped before the compare
+void checkClone() {
+    for (const std::string& doc : checkInputs()) {
+        JsonAllocator allocator;
+        JsonParser parser(&allocator);
+        std::string copy = doc;
+        Value* tree = parser.parse(&copy[0]);
+        std::string ref = toJson(tree);
+
+        JsonAllocator target;
+        JEncoder encoder;
+        std::vector<char> buf = encoder.encode(tree);
+        Value* v3 = JEncoder::decode(buf.data(), (int)buf.size());
+        JsonNode* fromV3 = v3 ? v3->clone_into(&target) : NULL;
+        std::fill(buf.begin(), buf.end(), 0);
+        check(toJson(fromV3) == ref, "clone_into v3", doc);
+
+        copy = doc;
+        JsonNode* fromTape = parser.parse_tape(&copy[0])->clone_into(&target, true);
+        std::fill(copy.begin(), copy.end(), ' ');
+        check(toJson(fromTape) == ref, "clone_into tape", doc);
+
+        copy = doc;
+        JsonNode* compacted = allocator.compact(parser.parse(&copy[0]), true);
+        std::fill(copy.begin(), copy.end(), ' ');
+        check(toJson(compacted) == ref && allocator.get_stats().blocks == 1, "compact", doc);
+    }
+
+    //raw numbers keep their digits in the copy
+    std::string text = "[1.50,-0.0,1e2,12345678901234567890,{\"n\":0.7}]";
+    JsonAllocator allocator;
+    JsonParser parser(&allocator);
+    parser.rawNumbers = true;
+    std::string copy = text;
+    Value* raw = parser.parse(&copy[0]);
+    std::string ref = toJson(raw);
+    JsonAllocator target;
+    JsonNode* clone = raw->clone_into(&target);
+    std::fill(copy.begin(), copy.end(), ' ');
+    check(toJson(clone) == ref && ref.find("1.50") != std::string::npos &&
+        ref.find("12345678901234567890") != std::string::npos, "clone_into raw numbers", text);
+    check(clone->at(0)->_flag == 2 && clone->at(0)->as_float() == 1.5, "clone_into raw number value", text);
+
+    //equal strings share one copy only with dedupStrings
+    std::string strs = "[\"abc\",\"abc\",{\"k\":\"abc\"},\"abd\"]";
+    copy = strs;
+    Value* v = parser.parse(&copy[0]);
+    JsonNode* dedup = v->clone_into(&target, true);
+    JsonNode* plain = v->clone_into(&target, false);
+    check(dedup->at(0)->as_str() == dedup->at(1)->as_str() &&
+        dedup->at(0)->as_str() == dedup->at(2)->get("k")->as_str() &&
+        dedup->at(0)->as_str() != dedup->at(3)->as_str(), "clone_into dedup", strs);
+    check(plain->at(0)->as_str() != plain->at(1)->as_str() && toJson(plain) == toJson(dedup),
+        "clone_into without dedup", strs);
+}
+
+//a raw number keeps its text and reads like the converted one
+static bool sameRawNumber(Value* arr, Value* ref, const std::string& text) {
+    if (!arr || arr->size() != 1) return false;
+    Value* v = arr->at(0);
+    Value* r = ref->at(0);
+    std::string json;
+    v->to_json(json);
+    if (v->_flag != 2 || json != text || v->type() != r->type()) return false;
+    if (v->type() == Type::Integer) return v->as_int() == r->as_int();
+    double a = v->as_float();
+    double b = r->as_float();
+    return memcmp(&a, &b, sizeof(a)) == 0;
+}
+
+void checkRawNumbers() {
+    std::vector<std::string> texts = {
+        "0", "-0", "1.50", "1e2", "1E+02", "-0.0", "3.14159265358979323846",
+        "9223372036854775807", "-9223372036854775808", "123456789012345678901234567890",
+    };
+    srand(13);
+    for (int k = 0; k < 500; ++k) {
+        std::string text = rand() % 3 ? "" : "-";
+        int digits = 1 + rand() % 22;
+        text += (char)('1' + rand() % 9);
+        for (int d = 1; d < digits; ++d) text += (char)('0' + rand() % 10);
+        if (rand() % 2) text += "." + std::to_string(rand() % 1000) + "0";
+        if (rand() % 4 == 0) text += "e-" + std::to_string(rand() % 300);
+        texts.push_back(text);
+    }
+
+    JsonAllocator allocator;
+    JsonParser parser(&allocator);
+    JsonParser raw(&allocator);
+    raw.rawNumbers = true;
+    for (const std::string& text : texts) {
+        std::string doc = "[" + text + "]";
+        std::string copy = doc;
+        Value* ref = parser.parse(&copy[0]);
+
+        copy = doc;
+        check(sameRawNumber(raw.parse(&copy[0]), ref, text), "rawNumbers parse", text);
+        check(sameRawNumber(raw.parse(doc.data(), doc.size()), ref, text), "rawNumbers parse(data, len)", text);
+        copy = doc;
+        check(sameRawNumber(raw.parse_indexed(&copy[0], copy.size()), ref, text), "rawNumbers parse_indexed", text);
+        copy = doc;
+        check(sameRawNumber(raw.parse_tape(&copy[0]), ref, text), "rawNumbers parse_tape", text);
+        for (size_t i = 0; i < doc.size(); ++i) raw.feed(doc.data() + i, 1);
+        check(sameRawNumber(raw.finish(), ref, text), "rawNumbers feed", text);
+
+        copy = doc;
+        JsonNode* clone = raw.parse(&copy[0])->clone_into(&allocator);
+        std::fill(copy.begin(), copy.end(), ' ');
+        check(sameRawNumber(clone, ref, text), "rawNumbers clone_into", text);
+    }
+
+    //int64 overflow is a Float, the digits stay
+    const char* overflow[] = { "9223372036854775808", "-9223372036854775809", "18446744073709551616" };
+    for (const char* text : overflow) {
+        std::string doc = std::string("[") + text + "]";
+        Value* v = raw.parse(doc.data(), doc.size());
+        std::string json;
+        if (v) v->at(0)->to_json(json);
+        check(v && v->at(0)->type() == Type::Float && json == text &&
+            v->at(0)->as_float() == strtod(text, NULL), "rawNumbers overflow", text);
+    }
+}
+
+typedef std::vector<std::pair<std::string, int64_t> > MemberModel;
+
+//lookups, size and member order of obj match the model, the first of a key wins
+static bool sameMembers(Value* obj, const MemberModel& model, const std::vector<std::string>& keys) {
+    if (obj->size() != model.size()) return false;
+    size_t i = 0;
+    for (auto it = obj->begin(); it != obj->end(); ++it, ++i) {
+        if (i >= model.size() || model[i].first != it.get_name() || (*it)->as_int() != model[i].second) return false;
+    }
+    for (const std::string& key : keys) {
+        Value* v = obj->get(key.c_str());
+        const std::pair<std::string, int64_t>* first = NULL;
+        for (const auto& m : model) {
+            if (m.first == key) {
+                first = &m;
+                break;
+            }
+        }
+        if (first ? !v || v->as_int() != first->second : v != NULL) return false;
+    }
+    return i == model.size();
+}
+
+void checkKeyIndex() {
+    //duplicate keys in a parsed document: the first one, as without the index
+    std::string doc = "{\"k0\":0,\"k1\":1,\"k0\":2,\"k2\":{\"a\":1,\"b\":2,\"a\":3},\"k1\":4}";
+    JsonAllocator allocator;
+    JsonParser parser(&allocator);
+    std::string copy = doc;
+    Value* root = parser.parse(&copy[0]);
+    index_keys(root, &allocator, 2);
+    check(root->_flag == 4 && root->get("k2")->_flag == 4, "index_keys", doc);
+    check(root->get_int("k0", -1) == 0 && root->get_int("k1", -1) == 1 && !root->get("k3") &&
+        root->get("k2")->get_int("a") == 1, "index_keys duplicate keys", doc);
+    JsonNode* first = ((JsonNode*)root)->remove("k0");
+    check(first && first->as_int() == 0 && root->get_int("k0", -1) == 2, "remove shows the next duplicate", doc);
+    first = ((JsonNode*)root)->remove("k0");
+    check(first && first->as_int() == 2 && !root->get("k0") && root->size() == 3, "remove the last duplicate", doc);
+
+    //random edits against a vector, with few keys so most are duplicates and slots collide
+    srand(21);
+    std::vector<std::string> keys;
+    for (int i = 0; i < 24; ++i) keys.push_back("key" + std::to_string(i));
+    for (int round = 0; round < 40; ++round) {
+        JsonAllocator arena;
+        JsonNode* obj = arena.allocNode(Type::Object);
+        MemberModel model;
+        std::string ops;
+        int64_t next = 0;
+        for (int k = 0; k < 400; ++k) {
+            int op = rand() % 10;
+            if (op <= 3) {
+                const std::string& key = keys[rand() % keys.size()];
+                obj->insert_pair(arena.strdup(key.c_str()), arena.alloc_int(next));
+                model.insert(model.begin(), std::make_pair(key, next++));
+                ops += "insert_pair ";
+            }
+            else if (op <= 5) {
+                const std::string& key = keys[rand() % keys.size()];
+                JsonNode* removed = obj->remove(key.c_str());
+                size_t i = 0;
+                while (i < model.size() && model[i].first != key) ++i;
+                if (i < model.size()) {
+                    check(removed && removed->as_int() == model[i].second, "KeyIndex remove", ops);
+                    model.erase(model.begin() + i);
+                }
+                else {
+                    check(!removed, "KeyIndex remove missing", ops);
+                }
+                ops += "remove ";
+            }
+            else if (op == 6 && !model.empty()) {
+                size_t i = rand() % model.size();
+                JsonNode* removed = obj->remove_at(i);
+                check(removed && removed->as_int() == model[i].second, "KeyIndex remove_at", ops);
+                model.erase(model.begin() + i);
+                ops += "remove_at ";
+            }
+            else if (op == 7) {
+                index_keys(obj, &arena, 1);
+                ops += "index_keys ";
+            }
+            else if (op == 8) {
+                obj->get(keys[rand() % keys.size()].c_str(), &arena);
+                ops += "get ";
+            }
+            else {
+                obj->reverse();
+                std::reverse(model.begin(), model.end());
+                ops += "reverse ";
+            }
+            if (!sameMembers(obj, model, keys)) {
+                check(false, "KeyIndex", ops);
+                break;
+            }
+        }
+    }
+}
+
+//every member of obj is found by its interned key, and only by that pointer
+static bool internedFound(Value* obj, KeyTable& table) {
+    for (auto it = obj->begin(); it != obj->end(); ++it) {
+        const char* key = table.find(it.get_name(), strlen(it.get_name()));
+        if (!key || key != it.get_name() || obj->get_interned(key) != obj->get(key)) return false;
+    }
+    return true;
+}
+
+void checkKeyTable() {
+    KeyTable table;
+    std::string a = "name";
+    std::string b = "name";
+    const char* key = table.intern(a.c_str());
+    check(key != a.c_str() && table.intern(b.c_str()) == key && table.intern("named", 4) == key &&
+        table.intern("Name") != key && table.size() == 2, "KeyTable intern", a);
+    check(table.find("name", 4) == key && !table.find("nam", 3) && KeyTable::length_of(key) == 4 &&
+        table.intern("", 0) == table.find("", 0), "KeyTable find", a);
+
+    //hash_of must match key_hash, the index probe of get_interned relies on it
+    srand(23);
+    std::vector<std::string> texts;
+    std::vector<const char*> keys;
+    for (int i = 0; i < 5000; ++i) {
+        std::string text;
+        int len = rand() % 40;
+        for (int k = 0; k < len; ++k) text += (char)(1 + rand() % 255);
+        texts.push_back(text);
+        keys.push_back(table.intern(text.c_str()));
+    }
+    bool ok = true;
+    for (size_t i = 0; i < texts.size() && ok; ++i) {
+        //the table grew many times, the pointers stay
+        ok = table.intern(texts[i].c_str()) == keys[i] && strcmp(keys[i], texts[i].c_str()) == 0 &&
+            KeyTable::hash_of(keys[i]) == key_hash(texts[i].c_str()) &&
+            KeyTable::length_of(keys[i]) == texts[i].size();
+    }
+    check(ok, "KeyTable hash_of", "random keys");
+
+    //interned by the parser, in a list, an indexed object, a tape and a clone
+    std::string doc = "{";
+    for (int i = 0; i < 40; ++i) {
+        if (i) doc += ",";
+        doc += "\"k" + std::to_string(i % 30) + "\":{\"id\":" + std::to_string(i) + ",\"x\":[{\"id\":1}]}";
+    }
+    doc += "}";
+    JsonAllocator allocator;
+    JsonParser parser(&allocator);
+    parser.keyTable = &table;
+    std::string copy = doc;
+    Value* tree = parser.parse(&copy[0]);
+    const char* id = table.intern("id");
+    check(tree && internedFound(tree, table) && tree->get_interned(table.intern("k3"))->get_interned(id)->as_int() == 3,
+        "JsonParser::keyTable", doc);
+    check(!tree->get_interned(b.c_str()) && !tree->get_interned(table.intern("zz")), "get_interned miss", doc);
+
+    parser.indexKeys = 16;
+    copy = doc;
+    Value* indexed = parser.parse(&copy[0]);
+    check(indexed && indexed->_flag == 4 && internedFound(indexed, table), "get_interned indexed", doc);
+    parser.indexKeys = 0;
+
+    copy = doc;
+    Value* tape = parser.parse_tape(&copy[0]);
+    check(tape && internedFound(tape, table), "get_interned tape", doc);
+
+    //a tree parsed without the table, interned afterwards
+    KeyTable later;
+    JsonParser plain(&allocator);
+    copy = doc;
+    Value* tree2 = plain.parse(&copy[0]);
+    index_keys(tree2, &allocator, 16);
+    intern_keys(tree2, &later);
+    check(tree2->_flag == 4 && internedFound(tree2, later) && internedFound(tree2->get("k1"), later),
+        "intern_keys", doc);
+    copy = doc;
+    Value* tape2 = plain.parse_tape(&copy[0]);
+    intern_keys(tape2, &later);
+    check(internedFound(tape2, later), "intern_keys tape", doc);
+
+    JsonNode* obj = allocator.allocNode(Type::Object);
+    for (int i = 0; i < 20; ++i) {
+        obj->append_pair(table.intern(("m" + std::to_string(i)).c_str()), allocator.alloc_int(i), &allocator);
+    }
+    check(obj->_flag == 5 && internedFound(obj, table), "get_interned append_pair", "");
+
+    later.clear();
+    check(later.size() == 0 && !later.find("id", 2), "KeyTable clear", "");
+}
+
+int runChecks() {
+    checkParsers();
+    checkBadInputs();
+    checkIndexReuse();
+    checkValidator();
+    checkUtf8();
+    checkStringRefs();
+    checkMapped();
+    checkLines();
+    checkProjection();
+    checkPool();
+    checkReset();
+    checkExternalBuffer();
+    checkBlockPool();
+    checkStats();
+    checkNumbers();
+    checkEncoder();
+    checkPatch();
+    checkChildArray();
+    checkClone();
+    checkRawNumbers();
+    checkKeyIndex();
+    checkKeyTable();
+    if (checkFailed) printf("%d checks failed\n", checkFailed);
+    else printf("all checks passed\n");
+    return checkFailed ? 1 : 0;
+}
+
 int main(int argc, const char * argv[]) {
     
     if (argc == 2) {
@@ -257,6 +1758,9 @@ int main(int argc, const char * argv[]) {
             //testHiml();
             return 0;
         }
+        if (!strcmp(argv[1], "check")) {
+            return runChecks();
+        }
     }
     else if (argc >= 3) {
         bool dmp = false;
@@ -293,5 +1797,6 @@ int main(int argc, const char * argv[]) {
     printf("Usage:\n");
     printf("  jsonc [-v2] <input json file> <output file>\n");
     printf("  jsonc -d <input binary file>\n");
+    printf("  jsonc check\n");
     return 1;
 }